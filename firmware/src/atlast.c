@@ -47,27 +47,55 @@
 #ifndef INDIVIDUALLY
 #define ARRAY			      /* Array subscripting words */
 #define BREAK			      /* Asynchronous break facility */
+#define CATCH			      /* CATCH and THROW exception handling */
 #define COMPILERW		      /* Compiler-writing words */
 #define CONIO			      /* Interactive console I/O */
 #define DEFFIELDS		      /* Definition field access for words */
 #define DOUBLE			      /* Double word primitives (2DUP) */
 #define EVALUATE		      /* The EVALUATE primitive */
 #define FILEIO			      /* File I/O primitives */
+#define MEMPOOL 		      /* ALLOCATE, FREE and RESIZE */
 #define MATH			      /* Math functions */
 #define MEMMESSAGE		      /* Print message for stack/heap errors */
+#define PEEPHOLE		      /* Peephole optimiser, superinstructions */
 #define PROLOGUE		      /* Prologue processing and auto-init */
 #define REAL			      /* Floating point numbers */
 #define SHORTCUTA		      /* Shortcut integer arithmetic words */
 #define SHORTCUTC		      /* Shortcut integer comparison */
 #define STRING			      /* String functions */
+#define SNAPSHOT		      /* Dictionary snapshot save/restore */
 #define SYSTEM			      /* System command function */
+#define TAILCALL		      /* Tail calls in compiled words */
+#define TASKS			      /* Cooperative multitasking */
 #ifndef NOMEMCHECK
 #define TRACE			      /* Execution tracing */
+#define VERIFY			      /* Stack effect verification */
 #define WALKBACK		      /* Walkback trace */
 #define WORDSUSED		      /* Logging of words used and unused */
 #endif /* NOMEMCHECK */
 #endif /* !INDIVIDUALLY */
 
+/*  NOPEEPHOLE compiles words just as they are written, without tail
+    calls, so the benchmarks can show what the peephole optimiser
+    saves.  */
+
+#ifdef NOPEEPHOLE
+#undef PEEPHOLE
+#endif
+
+/*  The walkback trace is normally kept on a stack of its own, to which
+    every call of a definition adds an item.  With RSWALKBACK, it is
+    instead worked out from the return stack when an error is reported,
+    which spares the calls that work and the walkback stack.  */
+
+#ifdef WALKBACK
+#ifndef RSWALKBACK
+#define WBSTACK 		      /* Walkback kept on its own stack */
+#endif
+#else
+#undef RSWALKBACK
+#endif
+
 
 #include "atldef.h"
 
@@ -75,6 +103,10 @@
 #include <math.h>
 #endif
 
+#ifdef CATCH
+#include <setjmp.h>
+#endif
+
 /* LINTLIBRARY */
 
 /* Implicit functions (work for all numeric types). */
@@ -118,16 +150,99 @@ atl_int atl_rstklen = 100;	      /* Return stack length */
 atl_int atl_heaplen = 1000;	      /* Heap length */
 atl_int atl_ltempstr = 256;	      /* Temporary string buffer length */
 atl_int atl_ntempstr = 4;	      /* Number of temporary string buffers */
+atl_int atl_linelen = 1024;	      /* Longest line atl_load() accepts */
+atl_int atl_poollen = 4096;	      /* ALLOCATE pool length in bytes */
+char *atl_incdir = NULL;	      /* Directory of files to include */
 
+#ifndef MULTIVM
 atl_int atl_trace = Falsity;	      /* Tracing if true */
 atl_int atl_walkback = Truth;	      /* Walkback enabled if true */
 atl_int atl_comment = Falsity;	      /* Currently ignoring a comment */
 atl_int atl_redef = Truth;	      /* Allow redefinition without issuing
                                          the "not unique" message. */
 atl_int atl_errline = 0;	      /* Line where last atl_load failed */
+#endif
 
 /*  Local variables  */
 
+#ifdef MULTIVM
+
+/*  With MULTIVM the variables below are fields of the selected
+    interpreter instance (see struct atl_vm in ATLDEF.H), which the
+    macros here and in ATLDEF.H reach through atl_vmp.	Each thread
+    starts out with the default instance, atl_vm0.  */
+
+static atl_vm atl_vm0 = {	      /* Default instance */
+    .vm_flags = {Falsity, Truth, Falsity, Truth, 0},
+    .vm_base = 10
+};
+__thread atl_vm *atl_vmp = &atl_vm0;  /* Instance selected for this thread */
+
+#define heapprot    (atl_vmp->vm_heapprot)
+#define heapend     (atl_vmp->vm_heapend)
+#define dhash	    (atl_vmp->vm_dhash)
+#define dhlen	    (atl_vmp->vm_dhlen)
+#define dhcount     (atl_vmp->vm_dhcount)
+#define wback	    (atl_vmp->vm_wback)
+#define wbptr	    (atl_vmp->vm_wbptr)
+#define tokbuf	    (atl_vmp->vm_tokbuf)
+#define instream    (atl_vmp->vm_instream)
+#define tokint	    (atl_vmp->vm_tokint)
+#define tokreal     (atl_vmp->vm_tokreal)
+#define base	    (atl_vmp->vm_base)
+#define evalstat    (atl_vmp->vm_evalstat)
+#define defpend     (atl_vmp->vm_defpend)
+#define forgetpend  (atl_vmp->vm_forgetpend)
+#define tickpend    (atl_vmp->vm_tickpend)
+#define ctickpend   (atl_vmp->vm_ctickpend)
+#define cbrackpend  (atl_vmp->vm_cbrackpend)
+#define stringlit   (atl_vmp->vm_stringlit)
+#define broken	    (atl_vmp->vm_broken)
+#define s_exit	    (atl_vmp->vm_s_exit)
+#define s_lit	    (atl_vmp->vm_s_lit)
+#define s_flit	    (atl_vmp->vm_s_flit)
+#define s_strlit    (atl_vmp->vm_s_strlit)
+#define s_dotparen  (atl_vmp->vm_s_dotparen)
+#define s_qbranch   (atl_vmp->vm_s_qbranch)
+#define s_branch    (atl_vmp->vm_s_branch)
+#define s_xdo	    (atl_vmp->vm_s_xdo)
+#define s_xqdo	    (atl_vmp->vm_s_xqdo)
+#define s_xloop     (atl_vmp->vm_s_xloop)
+#define s_pxloop    (atl_vmp->vm_s_pxloop)
+#define s_abortq    (atl_vmp->vm_s_abortq)
+#define primbase    (atl_vmp->vm_primbase)
+#define primmem     (atl_vmp->vm_primmem)
+#define s_pause     (atl_vmp->vm_s_pause)
+#define fgtask	    (atl_vmp->vm_fgtask)
+#define curtask     (atl_vmp->vm_curtask)
+#define taskseq     (atl_vmp->vm_taskseq)
+#define evaldepth   (atl_vmp->vm_evaldepth)
+#define taskdepth   (atl_vmp->vm_taskdepth)
+#define s_slit	    (atl_vmp->vm_s_slit)
+#define tokbase     (atl_vmp->vm_tokbase)
+#define toklen	    (atl_vmp->vm_toklen)
+#define ntokseg     (atl_vmp->vm_ntokseg)
+#define tokfree     (atl_vmp->vm_tokfree)
+#define tokhptr     (atl_vmp->vm_tokhptr)
+#define s_litplus   (atl_vmp->vm_s_litplus)
+#define s_litat     (atl_vmp->vm_s_litat)
+#define s_litbang   (atl_vmp->vm_s_litbang)
+#define s_iplus     (atl_vmp->vm_s_iplus)
+#define s_dupqbranch (atl_vmp->vm_s_dupqbranch)
+#define s_zqbranch  (atl_vmp->vm_s_zqbranch)
+#define s_2dup	    (atl_vmp->vm_s_2dup)
+#define s_tail	    (atl_vmp->vm_s_tail)
+#define peepw	    (atl_vmp->vm_peepw)
+#define peepat	    (atl_vmp->vm_peepat)
+#define npeep	    (atl_vmp->vm_npeep)
+#define profp	    (atl_vmp->vm_profp)
+#define profon	    (atl_vmp->vm_profon)
+#define incount     (atl_vmp->vm_incount)
+#define pool	    (atl_vmp->vm_pool)
+#define wblevel     (atl_vmp->vm_wblevel)
+#define catchp	    (atl_vmp->vm_catchp)
+#else /* MULTIVM */
+
     /* The evaluation stack */
 
 Exported stackitem *stack = NULL;     /* Evaluation stack */
@@ -137,10 +252,10 @@ Exported stackitem *stacktop;	      /* Stack top */
 
     /* The return stack */
 
-Exported dictword ***rstack = NULL;   /* Return stack */
-Exported dictword ***rstk;	      /* Return stack pointer */
-Exported dictword ***rstackbot;       /* Return stack bottom */
-Exported dictword ***rstacktop;       /* Return stack top */
+Exported rstackitem *rstack = NULL;   /* Return stack */
+Exported rstackitem *rstk;	      /* Return stack pointer */
+Exported rstackitem *rstackbot;       /* Return stack bottom */
+Exported rstackitem *rstacktop;       /* Return stack top */
 
     /* The heap */
 
@@ -153,6 +268,126 @@ Exported stackitem *heaptop;	      /* Top of heap */
 
 Exported dictword *dict = NULL;       /* Dictionary chain head */
 Exported dictword *dictprot = NULL;   /* First protected item in dictionary */
+#ifdef SNAPSHOT
+static stackitem *heapprot = NULL;    /* Heap allocation after atl_init() */
+#endif
+#ifdef NAMEARENA
+static stackitem *heapend = NULL;     /* Top of heap, above the name arena */
+#endif
+#endif /* MULTIVM */
+
+#ifdef ROMDICT
+
+    /* Primitive tables used in place as dictionary items */
+
+#define Romsegs     4		      /* Maximum number of ROM segments */
+
+static struct romseg {
+    const dictword *rbase;	      /* First item in the table */
+    int rlen;			      /* Number of items */
+    unsigned int rmask; 	      /* Hash bucket mask */
+    unsigned short *rbucket;	      /* Start of each bucket in rindex */
+    unsigned short *rindex;	      /* Item indices grouped by bucket */
+} romseg[Romsegs];
+static int nromseg = 0; 	      /* Number of ROM segments */
+#endif
+
+#ifdef HASHDICT
+
+    /* The dictionary hash index */
+
+#ifndef Dhashlen
+#define Dhashlen    256 	      /* Initial hash buckets (power of 2) */
+#endif
+#ifndef MULTIVM
+static dictword **dhash = NULL;       /* Hash bucket chain heads */
+static unsigned int dhlen = 0;	      /* Number of hash buckets */
+static unsigned int dhcount = 0;      /* Number of words in the index */
+#endif
+#endif /* HASHDICT */
+
+#ifdef TASKS
+
+    /* Cooperative tasks */
+
+#ifndef Tstklen
+#define Tstklen     64		      /* Task data stack length */
+#endif
+#ifndef Trstklen
+#define Trstklen    64		      /* Task return stack length */
+#endif
+
+typedef struct atl_task {
+    struct atl_task *tnext;	      /* Next task in the ring */
+    stackitem tid;		      /* Task number, 0 for foreground */
+    Boolean tpaused;		      /* Suspended by atl_pause() */
+    stackitem *tstack, *tstk, *tstacktop; /* Data stack */
+    rstackitem *trstack, *trstk, *trstacktop; /* Return stack */
+    atl_token *tip;		      /* Instruction pointer */
+#ifdef WBSTACK
+    dictword **twback, **twbptr;      /* Walkback trace */
+#endif
+#ifdef CATCH
+    struct atl_catch *tcatch;	      /* Innermost CATCH */
+#endif
+#ifdef MEMSTAT
+    stackitem *tstackmax;	      /* Stack maximum excursion */
+    rstackitem *trstackmax;	      /* Return stack maximum excursion */
+#endif
+    atl_token tcode[2]; 	      /* Initial code: task word, EXIT */
+} atl_task;
+
+#ifndef MULTIVM
+static atl_task *fgtask = NULL;       /* Foreground task, NULL until TASK */
+static atl_task *curtask = NULL;      /* Task now running */
+static stackitem taskseq = 0;	      /* Last task number assigned */
+static int evaldepth = 0;	      /* atl_eval() and atl_exec() nesting */
+static int taskdepth = 0;	      /* evaldepth at which tasks run */
+#endif
+#endif /* TASKS */
+
+#ifdef MEMPOOL
+
+    /* The dynamic memory pool */
+
+#ifndef Poolpage
+#define Poolpage    256 	      /* Pool page length in bytes */
+#endif
+#define Poolmin     ((long) ((Poolpage / 64) > 2 * sizeof(stackitem) ? \
+		     (Poolpage / 64) : 2 * sizeof(stackitem))) /* Smallest block */
+#define Poolclasses 6		      /* Block sizes Poolmin to Poolpage / 2 */
+#define Pgfree	    0xFF	      /* Class of an unused page */
+#define Pgrun	    0xFE	      /* Class of the first page of a run */
+#define Pgcont	    0xFD	      /* Class of the other pages of a run */
+#define Pgnil	    (-1)	      /* End of a page list */
+
+typedef struct {
+    unsigned char pgclass;	      /* Block size class, Pgfree, Pgrun, Pgcont */
+    unsigned short pgused;	      /* Blocks in use, or pages in run */
+    unsigned short pgcarved;	      /* Blocks ever handed out */
+    short pgnext, pgprev;	      /* Links in the page's list */
+    char *pgfree;		      /* Chain of freed blocks */
+    unsigned long long pgmap;	      /* Bit set for each block in use */
+} poolpage;
+
+typedef struct atl_pool {
+    char *pbase;		      /* First page */
+    int pnpages;		      /* Number of pages */
+    int pnfree; 		      /* Pages unused */
+    short phead[Poolclasses + 1];     /* Unused pages, then pages of each
+					 class with blocks to spare */
+    long pblocks;		      /* Blocks in use */
+    long pbytes, pmax;		      /* Bytes in blocks in use, maximum */
+    long prefused;		      /* Requests which could not be met */
+    poolpage ppage[1];		      /* Page table */
+} atl_pool;
+
+#ifndef MULTIVM
+static atl_pool *pool = NULL;	      /* Dynamic memory pool, if any */
+#endif
+#endif /* MEMPOOL */
+
+#ifndef MULTIVM
 
     /* The temporary string buffers */
 
@@ -161,16 +396,71 @@ Exported int cstrbuf = 0;	      /* Current temp string */
 
     /* The walkback trace stack */
 
-#ifdef WALKBACK
+#ifdef WBSTACK
 static dictword **wback = NULL;       /* Walkback trace buffer */
 static dictword **wbptr;	      /* Walkback trace pointer */
-#endif /* WALKBACK */
+#endif /* WBSTACK */
+#endif /* !MULTIVM */
+
+#ifdef RSWALKBACK
+
+    /* Words exword() was called to run, and where code that called
+       EVALUATE had reached, for the walkback */
+
+typedef struct atl_wblevel {
+    struct atl_wblevel *lprev;	      /* Enclosing level */
+    dictword *lword;		      /* Word it ran, NULL for EVALUATE */
+    atl_token *lip;		      /* Return address the word pushes */
+    rstackitem *lrstk;		      /* Where on the return stack */
+} atl_wblevel;
+
+#ifndef MULTIVM
+static atl_wblevel *wblevel = NULL;   /* Innermost call of exword() */
+#endif
+#endif /* RSWALKBACK */
+
+#ifdef CATCH
+
+    /* Exception frames.  CATCH keeps its frame on the C stack while
+       the word it runs executes, and THROW returns to it directly with
+       longjmp(), however deeply the word has nested, restoring the
+       interpreter state CATCH saved.  */
+
+typedef struct atl_catch {
+    struct atl_catch *cprev;	      /* Enclosing CATCH */
+    jmp_buf cjmp;		      /* Where CATCH resumes */
+    stackitem *cstk;		      /* Stack pointer */
+    rstackitem *crstk;		      /* Return stack pointer */
+    atl_token *cip;		      /* Instruction pointer */
+    dictword *cword;		      /* CATCH itself */
+#ifdef WBSTACK
+    dictword **cwbptr;		      /* Walkback trace pointer */
+#endif
+#ifdef RSWALKBACK
+    atl_wblevel *cwblevel;	      /* Innermost call of exword() */
+#endif
+#ifdef TASKS
+    int cevaldepth;		      /* atl_eval() and atl_exec() nesting */
+#endif
+    char *cinstream;		      /* Input stream */
+    atl_int ccomment;		      /* Comment pending state */
+    stackitem cstate;		      /* Compile state */
+    dictword *ccreate;		      /* Word pending creation */
+} atl_catch;
+
+#ifndef MULTIVM
+static atl_catch *catchp = NULL;      /* Innermost CATCH, NULL if none */
+#endif
+#endif /* CATCH */
+
+#ifndef MULTIVM
 
 #ifdef MEMSTAT
 Exported stackitem *stackmax;	      /* Stack maximum excursion */
-Exported dictword ***rstackmax;       /* Return stack maximum excursion */
+Exported rstackitem *rstackmax;       /* Return stack maximum excursion */
 Exported stackitem *heapmax;	      /* Heap maximum excursion */
 #endif
+#endif /* !MULTIVM */
 
 #ifdef FILEIO
 static
@@ -199,6 +489,7 @@ static
 
 #endif /* FILEIO */
 
+#ifndef MULTIVM
 static char tokbuf[128];	      /* Token buffer */
 static char *instream = NULL;	      /* Current input stream line */
 static long tokint;		      /* Scanned integer */
@@ -209,7 +500,7 @@ Exported atl_real rbuf0, rbuf1, rbuf2; /* Real temporary buffers */
 #endif
 #endif
 static long base = 10;		      /* Number base */
-Exported dictword **ip = NULL;	      /* Instruction pointer */
+Exported atl_token *ip = NULL;	      /* Instruction pointer */
 Exported dictword *curword = NULL;    /* Current word being executed */
 static int evalstat = ATL_SNORM;      /* Evaluator status */
 static Boolean defpend = False;       /* Token definition pending */
@@ -219,9 +510,11 @@ static Boolean ctickpend = False;     /* Compile-time tick ['] pending */
 static Boolean cbrackpend = False;    /* [COMPILE] pending */
 Exported dictword *createword = NULL; /* Address of word pending creation */
 static Boolean stringlit = False;     /* String literal anticipated */
+static long incount = 0;	      /* Files atl_include() has begun */
 #ifdef BREAK
-static Boolean broken = False;	      /* Asynchronous break received */
+static volatile Boolean broken = False; /* Asynchronous break received */
 #endif
+#endif /* !MULTIVM */
 
 #ifdef COPYRIGHT
 #ifndef HIGHC
@@ -239,19 +532,160 @@ static
    far more importantly, keeps it from being spoofed if a user redefines
    one of the words generated by the compiler.	*/
 
+#ifndef MULTIVM
 static stackitem s_exit, s_lit, s_flit, s_strlit, s_dotparen,
 		 s_qbranch, s_branch, s_xdo, s_xqdo, s_xloop,
 		 s_pxloop, s_abortq;
+#ifdef TASKS
+static stackitem s_pause;
+#endif
+#ifdef TOKTHREAD
+static stackitem s_slit;
+#endif
+#ifdef PEEPHOLE
+static stackitem s_litplus, s_litat, s_litbang, s_iplus,
+		 s_dupqbranch, s_zqbranch, s_2dup, s_tail;
+static dictword *peepw[4];	      /* Last words compiled... */
+static atl_token *peepat[4];	      /* ...and where they went */
+static int npeep = 0;		      /* Number of them remembered */
+#endif
+#endif
+
+#ifdef TOKTHREAD
+#ifndef MULTIVM
+
+    /* Primitive tables, in token order */
+
+static dictword *tokbase[Toksegs];    /* First item in each table */
+static int toklen[Toksegs];	      /* Number of items in each table */
+static int ntokseg = 0; 	      /* Number of tables */
+
+    /* Compilation of tokens into the heap */
+
+static atl_token *tokfree = NULL;     /* Next free token in last cell... */
+static stackitem *tokhptr = NULL;     /* ...valid while hptr is still this */
+#endif
+#endif /* TOKTHREAD */
+
+#ifdef PROFILE
+
+    /* The execution profile */
+
+#ifndef Proflen
+#define Proflen     256 	      /* Words profiled (power of 2) */
+#endif
+#ifndef Profdepth
+#define Profdepth   64		      /* Nested definitions timed */
+#endif
+#ifndef Profclock
+#include <time.h>
+#define Profclock() ((unsigned long) clock()) /* Time in any units */
+#endif
+
+typedef struct {
+    dictword *pword;		      /* Word, NULL if entry unused */
+    unsigned long pcalls;	      /* Times it was executed */
+    unsigned long long pself;	      /* Time in the word itself */
+    unsigned long long pincl;	      /* Time including words it calls */
+    int pactive;		      /* Activations being timed */
+} atl_profent;
+
+typedef struct atl_prof {
+    atl_profent *pcur;		      /* Word now running */
+    unsigned long ptime;	      /* Time it was dispatched */
+    unsigned long pwords;	      /* Words executed */
+    int pnframe;		      /* Definitions being timed */
+    struct {
+	atl_profent *fent;	      /* The definition */
+	rstackitem *frp;	      /* Return stack above its return address */
+	unsigned long ft0;	      /* Time it was entered */
+    } pframe[Profdepth];
+    atl_profent ptab[Proflen];	      /* Words, hashed by address */
+} atl_prof;
+
+#ifndef MULTIVM
+static atl_prof *profp = NULL;	      /* Profile, NULL until PROFILE */
+static Boolean profon = False;	      /* Profiling if true */
+#endif
+#endif /* PROFILE */
+
+/* The direct-threaded inner interpreter dispatches on labels with
+   GCC's labels-as-values extension, so it's only available when
+   compiling with GCC or a compatible compiler. */
+
+#ifdef DIRECTTHREAD
+#ifndef __GNUC__
+#undef DIRECTTHREAD
+#endif
+#endif
+
+#ifdef DIRECTTHREAD
+#ifndef MULTIVM
+static dictword *primbase = NULL;     /* Dictionary items for primt[] */
+#endif
+#endif
+
+/* Verified definitions run unchecked copies of the inline primitives
+   of the direct-threaded exword(), so verification is only of use
+   with it, and with stack checking enabled. */
+
+#ifndef DIRECTTHREAD
+#undef VERIFY
+#endif
+#ifdef NOMEMCHECK
+#undef VERIFY
+#endif
+
+/* Tail calls are compiled by the peephole optimiser. */
+
+#ifndef PEEPHOLE
+#undef TAILCALL
+#endif
 
 /*  Forward functions  */
 
 STATIC void exword(), trouble();
+#ifdef CATCH
+static void catchsave(), throwcode();
+#endif
 #ifndef NOMEMCHECK
 STATIC void notcomp(), divzero();
 #endif
 #ifdef WALKBACK
 STATIC void pwalkback();
 #endif
+#ifdef VERIFY
+STATIC Boolean verify();
+#endif
+#ifdef TASKS
+static void taskcut();
+#endif
+#ifdef PEEPHOLE
+STATIC Boolean compword();
+#endif
+#ifdef PROFILE
+STATIC void profword(), profnest(), profclose(), profdone();
+#endif
+
+/* The profiler's hooks in the inner interpreter, which vanish when
+   it isn't configured.  Profword() starts timing the word in curword,
+   Profnest() the definition in curword just entered, Profexit() ends
+   the timing of definitions returned from, and Proftail() does both
+   when a definition is replaced by a tail call. */
+
+#ifdef PROFILE
+#define Profword()  if (profon) profword()
+#define Profnest()  if (profon) profnest()
+#define Profexit()  if (profon) profclose(rstk)
+#define Proftail()  if (profon) { profclose(rstk - 1); profnest(); }
+#define Profdone()  if (profon) profdone()
+#else
+#define Profword()
+#define Profnest()
+#define Profexit()
+#define Proftail()
+#define Profdone()
+#endif
 
 /*  ALLOC  --  Allocate memory and error upon exhaustion.  */
 
@@ -268,6 +702,24 @@ static char *alloc(size)
     return cp;
 }
 
+#ifdef MULTIVM
+
+/*  PRIMALLOC  --  Allocate storage for primitive table items, chained
+		   to the instance so atl_vmfree() can release it.  */
+
+static char *primalloc(size)
+  unsigned int size;
+{
+    char **cp = (char **) alloc(size + sizeof(char *));
+
+    *cp = (char *) primmem;
+    primmem = cp;
+    return (char *) (cp + 1);
+}
+#else
+#define primalloc(size) alloc(size)
+#endif /* MULTIVM */
+
 /*  UCASE  --  Force letters in string to upper case.  */
 
 static void ucase(c)
@@ -282,6 +734,123 @@ static void ucase(c)
     }
 }
 
+#ifndef USE_SSCANF
+
+#ifdef REAL
+
+/*  REALSCAN  --  Scan a token as a real number: an optional minus
+		  sign, digits with an optional decimal point, and an
+		  optional exponent.  When the significant digits and
+		  the power of ten are small enough to be exact in a
+		  double, one multiplication or division gives the
+		  correctly rounded value; otherwise strtod() does the
+		  conversion. */
+
+static int realscan(s)
+  char *s;
+{
+    static const double p10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    char *cp = s;
+    Boolean neg = False, eneg = False;
+    double m = 0;
+    int ndig = 0, nsig = 0, pexp = 0, e = 0;
+
+    if (*cp == '-') {
+	neg = True;
+	cp++;
+    }
+    for (; isdigit(*cp); cp++, ndig++) {
+	if (nsig > 0 || *cp != '0') {
+	    m = m * 10 + (*cp - '0');
+	    nsig++;
+	}
+    }
+    if (*cp == '.') {
+	for (cp++; isdigit(*cp); cp++, ndig++) {
+	    if (nsig > 0 || *cp != '0') {
+		m = m * 10 + (*cp - '0');
+		nsig++;
+	    }
+	    pexp--;
+	}
+    }
+    if (ndig == 0)
+	return TokWord;
+    if (*cp == 'e' || *cp == 'E') {
+	cp++;
+	if (*cp == '-' || *cp == '+')
+	    eneg = *cp++ == '-';
+	if (!isdigit(*cp))
+	    return TokWord;
+	for (; isdigit(*cp); cp++) {
+	    if (e < 10000)
+		e = e * 10 + (*cp - '0');
+	}
+	pexp += eneg ? -e : e;
+    }
+    if (*cp != EOS)
+	return TokWord;
+    if (nsig <= 15 && pexp >= -22 && pexp <= 22) {
+	m = (pexp < 0) ? m / p10[-pexp] : m * p10[pexp];
+	tokreal = Dtor(neg ? -m : m);
+    } else {
+	tokreal = Dtor(strtod(s, NULL));
+    }
+    return TokReal;
+}
+#endif /* REAL */
+
+/*  NUMSCAN  --  Classify a token which begins with a digit or minus
+		 sign as an integer, real number, or word in one pass,
+		 storing the value of a number in tokint or tokreal.
+		 Integers follow the rules of strtoul() with a base of
+		 zero: a 0x prefix means hexadecimal and a leading zero
+		 octal.  Otherwise digits are in the current base. */
+
+static int numscan(s)
+  char *s;
+{
+    char *cp = s;
+    Boolean neg = False, ovf = False;
+    unsigned long v = 0;
+    int b = (base >= 2 && base <= 36) ? ((int) base) : 10, ndig = 0;
+
+    if (*cp == '-') {
+	neg = True;
+	cp++;
+    }
+    if (cp[0] == '0' && (cp[1] == 'x' || cp[1] == 'X') && isxdigit(cp[2])) {
+	b = 16;
+	cp += 2;
+    } else if (cp[0] == '0' && b == 10) {
+	b = 8;
+    }
+    for (; *cp != EOS; cp++, ndig++) {
+	int d = isdigit(*cp) ? (*cp - '0') :
+		(isalpha(*cp) ? (toupper(*cp) - 'A' + 10) : 99);
+
+	if (d >= b)
+	    break;
+	if (v > (((unsigned long) -1) - d) / b)
+	    ovf = True;
+	v = (v * b) + d;
+    }
+    if (*cp == EOS && ndig > 0) {
+	/* Like strtoul(), saturate on overflow and negate otherwise */
+	tokint = ovf ? -1L : ((long) (neg ? -v : v));
+	return TokInt;
+    }
+#ifdef REAL
+    return realscan(s);
+#else
+    return TokWord;
+#endif
+}
+#endif /* !USE_SSCANF */
+
 /*  TOKEN  --  Scan a token and return its type.  */
 
 static int token(cp)
@@ -393,7 +962,7 @@ static int token(cp)
 	/* See if token is a comment to end of line character.	If so, discard
 	   the rest of the line and return null for this token request. */
 
-        if (strcmp(tokbuf, "\\") == 0) {
+        if (tokbuf[0] == '\\' && tokbuf[1] == EOS) {
 	    while (*sp != EOS)
 		sp++;
 	    *cp = sp;
@@ -403,7 +972,7 @@ static int token(cp)
 	/* See if this token is a comment open delimiter.  If so, set to
 	   ignore all characters until the matching comment close delimiter. */
 
-        if (strcmp(tokbuf, "(") == 0) {
+        if (tokbuf[0] == '(' && tokbuf[1] == EOS) {
 	    while (*sp != EOS) {
                 if (*sp == ')')
 		    break;
@@ -421,8 +990,12 @@ static int token(cp)
 	/* See if the token is a number. */
 
         if (isdigit(tokbuf[0]) || tokbuf[0] == '-') {
+#ifdef USE_SSCANF
 	    char tc;
-	    char *tcp;
+#ifdef REAL
+	    double td;
+#endif
+#endif
 
 #ifdef OS2
 	    /* Compensate for error in OS/2 sscanf() library function */
@@ -436,29 +1009,194 @@ static int token(cp)
 #ifdef USE_SSCANF
             if (sscanf(tokbuf, "%li%c", &tokint, &tc) == 1)
 		return TokInt;
-#else
-    	    tokint = strtoul(tokbuf, &tcp, 0);
-	    if (*tcp == 0) {
-	    	return TokInt;
-	    }
-#endif
 #ifdef REAL
-            if (sscanf(tokbuf, "%lf%c", &tokreal, &tc) == 1)
+            if (sscanf(tokbuf, "%lf%c", &td, &tc) == 1) {
+		tokreal = Dtor(td);
 		return TokReal;
+	    }
+#endif
+#else
+	    return numscan(tokbuf);
 #endif
 	}
 	return TokWord;
     }
 }
 
+#ifdef HASHDICT
+#define DhashfNeeded
+#endif
+#ifdef ROMDICT
+#ifndef DhashfNeeded
+#define DhashfNeeded
+#endif
+#endif
+
+#ifdef DhashfNeeded
+
+/*  DHASHF  --  Compute the hash of a word name.  */
+
+static unsigned int dhashf(name)
+  const char *name;
+{
+    unsigned int h = 5381;
+
+    while (*name != EOS)
+	h = (h << 5) + h + ((unsigned char) *name++);
+    return h;
+}
+#endif /* DhashfNeeded */
+
+#ifdef HASHDICT
+
+/*  DHREBUILD  --  Rebuild the hash index from the dictionary chain
+		   with the given number of buckets.  Each bucket
+		   chain must list words newest first, just as the
+		   dictionary does, so that a redefinition shadows
+		   the earlier word.  Walking the dictionary and
+		   pushing each word on its bucket leaves the chains
+		   oldest first, so we reverse them afterward. */
+
+static void dhrebuild(len)
+  unsigned int len;
+{
+    dictword *dw;
+    unsigned int i;
+
+    if (dhash != NULL)
+	free((char *) dhash);
+    dhash = (dictword **) alloc(len * sizeof(dictword *));
+    dhlen = len;
+    dhcount = 0;
+    for (i = 0; i < dhlen; i++)
+	dhash[i] = NULL;
+    for (dw = dict; dw != NULL; dw = dw->wnext) {
+	i = dhashf(dw->wname + 1) & (dhlen - 1);
+	dw->whnext = dhash[i];
+	dhash[i] = dw;
+	dhcount++;
+    }
+    for (i = 0; i < dhlen; i++) {
+	dictword *rev = NULL, *next;
+
+	for (dw = dhash[i]; dw != NULL; dw = next) {
+	    next = dw->whnext;
+	    dw->whnext = rev;
+	    rev = dw;
+	}
+	dhash[i] = rev;
+    }
+}
+
+/*  DHINSERT  --  Add a word, which has just been placed at the head
+		  of the dictionary, to the hash index.  The bucket
+		  table is doubled when the chains grow too long. */
+
+static void dhinsert(dw)
+  dictword *dw;
+{
+    unsigned int i;
+
+    if (dhash == NULL || dhcount >= 2 * dhlen) {
+	dhrebuild(dhash == NULL ? Dhashlen : 2 * dhlen);
+	return; 		      /* Rebuild indexed the new word */
+    }
+    i = dhashf(dw->wname + 1) & (dhlen - 1);
+    dw->whnext = dhash[i];
+    dhash[i] = dw;
+    dhcount++;
+}
+
+/*  DHREMOVE  --  Remove a word from the hash index.  Words are
+		  removed newest first by FORGET and atl_unwind(),
+		  so the word is almost always at the head of its
+		  bucket chain. */
+
+static void dhremove(dw)
+  dictword *dw;
+{
+    dictword **dp;
+
+    if (dhash == NULL)
+	return;
+    dp = &dhash[dhashf(dw->wname + 1) & (dhlen - 1)];
+    while (*dp != NULL) {
+	if (*dp == dw) {
+	    *dp = dw->whnext;
+	    dhcount--;
+	    break;
+	}
+	dp = &((*dp)->whnext);
+    }
+}
+#endif /* HASHDICT */
+
+#ifdef ROMDICT
+
+/*  DICTNEXT  --  Return the word following a given one in a listing
+		  of the whole dictionary: the chain of words defined
+		  at run time, then each ROM segment, most recent
+		  first.  Given NULL, returns the first word. */
+
+static dictword *dictnext(dw)
+  dictword *dw;
+{
+    int i;
+
+    if (dw == NULL && dict != NULL)
+	return dict;
+    for (i = nromseg - 1; i >= 0; i--) {
+	const dictword *rb = romseg[i].rbase;
+
+	if (dw >= rb && dw < rb + romseg[i].rlen) {
+	    if (++dw < rb + romseg[i].rlen)
+		return dw;
+	    return (i > 0) ? (dictword *) romseg[i - 1].rbase : NULL;
+	}
+    }
+    if (dw != NULL && dw->wnext != NULL)
+	return dw->wnext;
+    return (nromseg > 0) ? (dictword *) romseg[nromseg - 1].rbase : NULL;
+}
+
+/*  ROMLOOKUP  --  Look up a name in the ROM segments, most recently
+		   defined first. */
+
+static dictword *romlookup(name)
+  char *name;
+{
+    unsigned int h = dhashf(name);
+    int i;
+
+    for (i = nromseg - 1; i >= 0; i--) {
+	struct romseg *rs = &romseg[i];
+	unsigned int b = h & rs->rmask, k;
+
+	for (k = rs->rbucket[b]; k < rs->rbucket[b + 1]; k++) {
+	    const dictword *dw = &rs->rbase[rs->rindex[k]];
+
+	    if (!(dw->wname[0] & WORDHIDDEN) &&
+		(strcmp(name, dw->wname + 1) == 0))
+		return (dictword *) dw;
+	}
+    }
+    return NULL;
+}
+#endif /* ROMDICT */
+
 /*  LOOKUP  --	Look up token in the dictionary.  */
 
 static dictword *lookup(tkname)
   char *tkname;
 {
-    dictword *dw = dict;
+    dictword *dw;
 
     ucase(tkname);		      /* Force name to upper case */
+#ifdef HASHDICT
+    dw = (dhash == NULL) ? NULL : dhash[dhashf(tkname) & (dhlen - 1)];
+#else
+    dw = dict;
+#endif
     while (dw != NULL) {
 	if (!(dw->wname[0] & WORDHIDDEN) &&
 	     (strcmp(dw->wname + 1, tkname) == 0)) {
@@ -467,8 +1205,16 @@ static dictword *lookup(tkname)
 #endif
 	    break;
 	}
+#ifdef HASHDICT
+	dw = dw->whnext;
+#else
 	dw = dw->wnext;
+#endif
     }
+#ifdef ROMDICT
+    if (dw == NULL)
+	dw = romlookup(tkname);	      /* Try the primitive tables */
+#endif
     return dw;
 }
 
@@ -557,6 +1303,38 @@ void atl_memstat()
 	((long) (heapmax - heap)),
 	atl_heaplen,
 	(100L * (hptr - heap)) / atl_heaplen);
+#ifdef MEMPOOL
+    if (pool != NULL) {
+	long plen = ((long) pool->pnpages) * Poolpage;
+	int c, pg, held[Poolclasses + 1];
+
+	V printf(fmt, "Pool bytes",
+	    pool->pbytes,
+	    pool->pmax,
+	    plen,
+	    (100L * pool->pbytes) / plen);
+
+	/* Pages held by each block size, to show how the blocks in
+	   use are spread over them. */
+
+	for (c = 0; c <= Poolclasses; c++)
+	    held[c] = 0;
+	for (pg = 0; pg < pool->pnpages; pg++) {
+	    c = pool->ppage[pg].pgclass;
+	    if (c < Poolclasses)
+		held[c]++;
+	    else if (c != Pgfree)
+		held[Poolclasses]++;
+	}
+	V printf("\n  Pool blocks in use: %ld, requests refused: %ld\n",
+	    pool->pblocks, pool->prefused);
+	V printf("  Pool pages: %d unused, %d in runs, by block size",
+	    pool->pnfree, held[Poolclasses]);
+	for (c = 0; c < Poolclasses && (Poolmin << c) <= Poolpage / 2; c++)
+	    V printf(" %ld:%d", Poolmin << c, held[c]);
+	V printf("\n");
+    }
+#endif
 }
 #endif /* MEMSTAT */
 
@@ -566,45 +1344,338 @@ void atl_memstat()
 	       name and initial values for its attributes, returns
 	       the newly-allocated dictionary item. */
 
-static void enter(tkname)
-  char *tkname;
+#ifdef NAMEARENA
+
+/*  NAMEALLOC  --  Allocate a name buffer of len bytes from the name
+		   arena.  The arena grows down from the top of the heap
+		   by lowering heaptop, so the heap and the names share
+		   the space between them and the usual heap overflow
+		   checks keep the heap out of the names.  Returns NULL
+		   if the heap is full. */
+
+static char *namealloc(len)
+  unsigned int len;
 {
-    /* Allocate name buffer */
-    createword->wname = alloc(((unsigned int) strlen(tkname) + 2));
-    createword->wname[0] = 0;	      /* Clear flags */
-    V strcpy(createword->wname + 1, tkname); /* Copy token to name buffer */
-    createword->wnext = dict;	      /* Chain rest of dictionary to word */
-    dict = createword;		      /* Put word at head of dictionary */
+    stackitem *np = heaptop - ((len + (sizeof(stackitem) - 1)) /
+				sizeof(stackitem));
+
+    if (np < hptr)
+	return NULL;
+    heaptop = np;
+    return (char *) np;
 }
 
-#ifdef Keyhit
+/*  NAMETOP  --  Return the bottom of the arena names of the words in
+		 the dictionary from dw back.  Since names are allocated
+		 in the order words are defined and words are released
+		 newest first, setting heaptop to this releases the
+		 names of all the words defined after dw at once. */
 
-/*  KBQUIT  --	If this system allows detecting key presses, handle
-		the pause, resume, and quit protocol for the word
-		listing facilities.  */
+static stackitem *nametop(dw)
+  dictword *dw;
+{
+    for (; dw != NULL; dw = dw->wnext) {
+	if (dw->wname >= (char *) heaptop && dw->wname < (char *) heapend)
+	    return (stackitem *) dw->wname;
+    }
+    return heapend;
+}
+#endif /* NAMEARENA */
 
-static Boolean kbquit()
+/*  USERWORD  --  Test whether a word may be forgotten: it must lie in
+		  the heap and have been defined after dictprot.  The
+		  heap is allocated upward and released newest first,
+		  so a word's address orders it in the dictionary and
+		  this takes no walk of the chain. */
+
+static Boolean userword(dw)
+  dictword *dw;
 {
-    int key;
+    stackitem *sp = (stackitem *) dw, *pp = (stackitem *) dictprot;
 
-    if ((key = Keyhit()) != 0) {
-        V printf("\nPress RETURN to stop, any other key to continue: ");
-	while ((key = Keyhit()) == 0) ;
-        if (key == '\r' || (key == '\n'))
-	    return True;
-    }
-    return False;
+    if (sp < heap || sp >= hptr)
+	return False;		      /* Primitive or built-in word */
+    return (pp < heap || pp >= hptr || sp > pp) ? True : False;
 }
-#endif /* Keyhit */
 
-/*  Primitive word definitions.  */
+/*  DICTCUT  --  Cut the dictionary back so that dw is once more its
+		 newest word.  Only with the name arena and no hash
+		 index is this done in constant time, by resetting
+		 the dictionary head.  With HASHDICT every word
+		 dropped must be visited, since its hash chain still
+		 points to it and the heap it lies in is about to be
+		 reused; as the dropped words are the newest in their
+		 chains each comes off the head of its chain, so the
+		 cost grows with the words dropped, not those kept.
+		 Without the name arena each dropped name is freed.
+		 The caller restores hptr and, with the name arena,
+		 heaptop, then calls heapcut(). */
 
-#ifdef NOMEMCHECK
-#define Compiling
+static void dictcut(dw)
+  dictword *dw;
+{
+#if defined(HASHDICT) || !defined(NAMEARENA)
+    while (dict != NULL && dict != dictprot && dict != dw) {
+#ifdef HASHDICT
+	dhremove(dict); 	      /* Drop item from the hash index */
+#endif
+#ifndef NAMEARENA
+	if (dict->wname != NULL)
+	    free(dict->wname);	      /* Release name string for item */
+#endif
+	dict = dict->wnext;	      /* Link to previous item */
+    }
+#else
+    dict = dw;
+#endif
+#ifdef TOKTHREAD
+    tokhptr = NULL;		      /* No partly filled code cell */
+#endif
+}
+
+/*  HEAPCUT  --  Called once the dictionary has been cut back from
+		 odict and the heap back to hptr.  Ends any task left
+		 running code in the heap released and, if words have
+		 gone, calls the Forgotten hook in the configuration,
+		 for the application to drop any it holds.  With hptr
+		 restored, atl_defined() tells which those are by
+		 address alone. */
+
+static void heapcut(odict)
+  dictword *odict;
+{
+#ifdef TASKS
+    taskcut();			      /* End tasks running what went */
+#endif
+#ifdef Forgotten
+    if (dict != odict)
+	Forgotten();		      /* Let the application drop its words */
+#endif
+}
+
+static void enter(tkname)
+  char *tkname;
+{
+    /* Allocate name buffer */
+#ifdef NAMEARENA
+    createword->wname = namealloc(((unsigned int) strlen(tkname) + 2));
+    if (createword->wname == NULL) {
+	hptr = (stackitem *) createword; /* Release the word's item */
+	createword = NULL;
+#ifndef NOMEMCHECK
+	heapover();
+#endif
+	return;
+    }
+#else
+    createword->wname = alloc(((unsigned int) strlen(tkname) + 2));
+#endif
+    createword->wname[0] = 0;	      /* Clear flags */
+    V strcpy(createword->wname + 1, tkname); /* Copy token to name buffer */
+    createword->wnext = dict;	      /* Chain rest of dictionary to word */
+    dict = createword;		      /* Put word at head of dictionary */
+#ifdef HASHDICT
+    dhinsert(createword);	      /* Index it for lookup() */
+#endif
+}
+
+#ifdef TOKTHREAD
+
+/*  TOKSEG  --  Add a table of primitive words to the token space.  */
+
+static void tokseg(pt, n)
+  dictword *pt;
+  int n;
+{
+    if (ntokseg < Toksegs) {
+	tokbase[ntokseg] = pt;
+	toklen[ntokseg++] = n;
+    }
+}
+
+/*  WORDTOK  --  Return the token for a word, or zero if it has none:
+		 a word beyond the first Tokprim cells of the heap or
+		 in a primitive table past the last of Toksegs. */
+
+static atl_token wordtok(dw)
+  dictword *dw;
+{
+    stackitem *wp = (stackitem *) dw;
+    long t = 0;
+    int i;
+
+    if (wp > heap && wp < heaptop) {
+	return (wp - heap) < Tokprim ? (atl_token) (wp - heap) : 0;
+    }
+    for (i = 0; i < ntokseg; i++) {
+	if (dw >= tokbase[i] && dw < tokbase[i] + toklen[i])
+	    return (atl_token) (Tokprim + t + (dw - tokbase[i]));
+	t += toklen[i];
+    }
+    return 0;
+}
+
+/*  TOKPRIM  --  Return the primitive word for a token.  The first
+		 table is looked up in line by Tokword(). */
+
+static dictword *tokprim(t)
+  unsigned int t;
+{
+    int i;
+
+    t -= Tokprim;
+    for (i = 0; i < ntokseg; i++) {
+	if (t < (unsigned int) toklen[i])
+	    return tokbase[i] + t;
+	t -= toklen[i];
+    }
+    return NULL;
+}
+
+#define Wordtok(dw) wordtok(dw)
+#define Tokword(t)  ((t) < Tokprim ? (dictword *) (heap + (t)) : \
+		     ((t) - Tokprim) < toklen[0] ? \
+		     tokbase[0] + ((t) - Tokprim) : tokprim(t))
+
+/*  CTSTORE  --  Compile a token.  Tokens are packed into the last cell
+		 of the heap until it's full, or until anything else
+		 is allocated on the heap.  */
+
+#undef Memerrs
+#define Memerrs False
+
+static Boolean ctstore(t)
+  atl_token t;
+{
+    atl_token *tp = (hptr == tokhptr) ? tokfree : (atl_token *) hptr;
+
+    if (tp == (atl_token *) hptr) {
+	Ho(1);
+	Hstore = 0;
+    }
+    *tp++ = t;
+    tokfree = tp;
+    tokhptr = hptr;
+    return True;
+}
+
+/*  CTWORD  --  Compile a reference to a word.  */
+
+static Boolean ctword(dw)
+  dictword *dw;
+{
+    atl_token t = wordtok(dw);
+
+    if (t == 0) {
+#ifndef NOMEMCHECK
+	heapover();		      /* Out of token space */
+#endif
+	return False;
+    }
+    return ctstore(t);
+}
+
+#undef Memerrs
+#define Memerrs
+
+#else /* !TOKTHREAD */
+#define Wordtok(dw) (dw)
+#define Tokword(t)  (t)
+#endif /* TOKTHREAD */
+
+#ifdef Keyhit
+
+/*  KBQUIT  --	If this system allows detecting key presses, handle
+		the pause, resume, and quit protocol for the word
+		listing facilities.  */
+
+static Boolean kbquit()
+{
+    int key;
+
+#ifdef BREAK
+    if (broken) 		      /* A break request quits the listing */
+	return True;
+#endif
+    if ((key = Keyhit()) != 0) {
+        V printf("\nPress RETURN to stop, any other key to continue: ");
+	while ((key = Keyhit()) == 0) ;
+        if (key == '\r' || (key == '\n'))
+	    return True;
+    }
+    return False;
+}
+#endif /* Keyhit */
+
+/*  Primitive word definitions.  */
+
+#ifdef NOMEMCHECK
+#define Compiling
 #else
 #define Compiling if (state == Falsity) {notcomp(); return;}
 #endif
+
+/*  Compiling code.  Compword() compiles a reference to a word,
+    Compconst() an in-line branch offset or token, and Chere is the
+    address at which the next one will be placed.  Longer in-line data
+    are stored with Hstore, starting a new cell, and read at run time
+    from the cell that Ipalign() rounds ip up to.  Tokoff() fetches
+    the in-line offset at an address, and Ipoff the one at ip.  */
+
+#ifdef TOKTHREAD
+#define Compword(w) if (!ctword((dictword *) (w))) return Memerrs
+#define Compconst(x) if (!ctstore((atl_token) (x))) return Memerrs
+#define Chere	    ((hptr == tokhptr) ? tokfree : (atl_token *) hptr)
+#define Ipalign(p)  ((atl_token *) ((((stackitem) (p)) + \
+			(sizeof(stackitem) - 1)) & \
+			~((stackitem) (sizeof(stackitem) - 1))))
+#define Tokoff(p)   ((stackitem) ((short) *(p)))
+#else
+#define Compword(w) Compconst(w)
 #define Compconst(x) Ho(1); Hstore = (stackitem) (x)
+#define Chere	    ((atl_token *) hptr)
+#define Ipalign(p)  (p)
+#define Tokoff(p)   ((stackitem) *(p))
+#endif
+#define Ipoff	    Tokoff(ip)
+#define Tokcell     (sizeof(stackitem) / sizeof(atl_token)) /* Tokens/cell */
+
+/*  With PEEPHOLE, words are compiled by compword(), which may instead
+    rewrite the code before them.  Peepfence marks a place in the code
+    a branch may reach, which no rewrite may span.  */
+
+#ifdef PEEPHOLE
+#undef Compword
+#define Compword(w) if (!compword((dictword *) (w))) return Memerrs
+#define Peepfence   npeep = 0
+#else
+#define Peepfence
+#endif
+#define Complit(v)  if (!complit((stackitem) (v))) return Memerrs
+
+/*  COMPLIT  --  Compile a literal, as (SLIT) if it's short enough.  */
+
+#undef Memerrs
+#define Memerrs False
+
+static Boolean complit(v)
+  stackitem v;
+{
+#ifdef TOKTHREAD
+    if (v == (short) v) {
+	Compword(s_slit);	      /* Compile short literal word */
+	Compconst(v);		      /* Compile literal in line */
+	return True;
+    }
+#endif
+    Compword(s_lit);		      /* Compile load literal word */
+    Ho(1);
+    Hstore = v; 		      /* Compile literal in line */
+    return True;
+}
+
+#undef Memerrs
+#define Memerrs
 #define Skipstring ip += *((char *) ip)
 
 prim P_plus()			      /* Add two numbers */
@@ -769,7 +1840,7 @@ prim P_not()			      /* Logical negation */
 
 prim P_shift()			      /* Shift:  value nbits -- value */
 {
-    Sl(1);
+    Sl(2);
     S1 = (S0 < 0) ? (((unsigned long) S1) >> (-S0)) :
 		    (((unsigned long) S1) <<   S0);
     Pop;
@@ -933,6 +2004,286 @@ prim P_cequal() 		      /* Align heap pointer after storing */
     }
 }
 
+/*  Dynamic memory primitives  */
+
+#ifdef MEMPOOL
+
+/*  ALLOCATE, FREE and RESIZE take their blocks from a pool of Poolpage
+    byte pages placed below the temporary strings at the bottom of the
+    heap, so the pointer checks of @, ! and the rest accept them.  The
+    pool is apart from the dictionary: FORGET, markers and snapshots
+    leave its blocks alone, and only atl_init() releases them all.
+    A request of up to half a page is rounded up to a power of two
+    from Poolmin and given a block from a page divided into blocks of
+    that size; a larger one is given a run of whole pages.  Each size
+    class keeps a list of its pages with blocks to spare, and each page
+    a chain of its freed blocks and a map of those in use, so finding,
+    checking and releasing a block take a fixed number of steps.  A
+    block wastes less than half its length, and a page whose blocks
+    have all been freed goes back to the unused pages for any size.  */
+
+#define Ior_allocate	(-59)	      /* ALLOCATE failed */
+#define Ior_free	(-60)	      /* FREE of a block not allocated */
+#define Ior_resize	(-61)	      /* RESIZE failed */
+
+/*  PGLINK  --  Add a page to the head of a page list.	*/
+
+static void pglink(list, pg)
+  int list, pg;
+{
+    poolpage *pp = &pool->ppage[pg];
+
+    pp->pgprev = Pgnil;
+    if ((pp->pgnext = pool->phead[list]) != Pgnil)
+	pool->ppage[pp->pgnext].pgprev = pg;
+    pool->phead[list] = pg;
+}
+
+/*  PGUNLINK  --  Remove a page from a page list.  */
+
+static void pgunlink(list, pg)
+  int list, pg;
+{
+    poolpage *pp = &pool->ppage[pg];
+
+    if (pp->pgprev == Pgnil)
+	pool->phead[list] = pp->pgnext;
+    else
+	pool->ppage[pp->pgprev].pgnext = pp->pgnext;
+    if (pp->pgnext != Pgnil)
+	pool->ppage[pp->pgnext].pgprev = pp->pgprev;
+}
+
+/*  POOLRESET  --  Release every block in the pool.  */
+
+static void poolreset()
+{
+    int i;
+
+    for (i = 0; i <= Poolclasses; i++)
+	pool->phead[i] = Pgnil;
+    for (i = pool->pnpages - 1; i >= 0; i--) {
+	pool->ppage[i].pgclass = Pgfree;
+	pglink(0, i);		      /* Lowest page at the head */
+    }
+    pool->pnfree = pool->pnpages;
+    pool->pblocks = pool->pbytes = pool->pmax = pool->prefused = 0;
+}
+
+/*  POOLFITS  --  Test whether a request could fit in the pool at all.
+		  Requests are checked with this before poolsize()
+		  rounds them up, which a huge one would overflow.  */
+
+static Boolean poolfits(n)
+  stackitem n;
+{
+    return (pool != NULL && n >= 0 &&
+	    n <= ((long) pool->pnpages) * Poolpage) ? True : False;
+}
+
+/*  POOLSIZE  --  Length of the block a request is given, which
+		  poolfits() must have passed.  */
+
+static long poolsize(n)
+  stackitem n;
+{
+    long bsize = Poolmin;
+
+    if (n > Poolpage / 2)
+	return ((n - 1) / Poolpage + 1) * Poolpage;
+    while (bsize < n)
+	bsize <<= 1;
+    return bsize;
+}
+
+/*  POOLALLOC  --  Allocate a block of at least n bytes.  Returns NULL
+		   if the pool can't supply one.  */
+
+static char *poolalloc(n)
+  stackitem n;
+{
+    poolpage *pp;
+    char *bp;
+    long bsize;
+    int c, pg;
+
+    if (!poolfits(n)) {
+	if (pool != NULL)
+	    pool->prefused++;
+	return NULL;
+    }
+    bsize = poolsize(n);
+    if (bsize > Poolpage / 2) {
+	int npg = bsize / Poolpage, len = 0;
+
+	/* A run of pages.  A single page is the first unused one;
+	   longer runs are sought from the top of the pool down, away
+	   from the pages the size classes take from the bottom.  */
+
+	if (npg == 1) {
+	    pg = pool->phead[0];
+	} else {
+	    for (pg = pool->pnpages - 1; pg >= 0 && len < npg; pg--)
+		len = (pool->ppage[pg].pgclass == Pgfree) ? len + 1 : 0;
+	    pg = (len == npg) ? pg + 1 : Pgnil;
+	}
+	if (pg == Pgnil) {
+	    pool->prefused++;
+	    return NULL;
+	}
+	for (c = pg; c < pg + npg; c++) {
+	    pgunlink(0, c);
+	    pool->ppage[c].pgclass = Pgcont;
+	}
+	pp = &pool->ppage[pg];
+	pp->pgclass = Pgrun;
+	pp->pgused = npg;
+	pool->pnfree -= npg;
+	bp = pool->pbase + ((long) pg) * Poolpage;
+    } else {
+	for (c = 0; (Poolmin << c) < bsize; c++) ;
+	if ((pg = pool->phead[c + 1]) == Pgnil) {
+	    if ((pg = pool->phead[0]) == Pgnil) {
+		pool->prefused++;
+		return NULL;
+	    }
+	    pgunlink(0, pg);	      /* Divide an unused page into blocks */
+	    pool->pnfree--;
+	    pp = &pool->ppage[pg];
+	    pp->pgclass = c;
+	    pp->pgused = pp->pgcarved = 0;
+	    pp->pgfree = NULL;
+	    pp->pgmap = 0;
+	    pglink(c + 1, pg);
+	}
+	pp = &pool->ppage[pg];
+	if ((bp = pp->pgfree) != NULL) {
+	    pp->pgfree = *((char **) bp);
+	} else {
+	    bp = pool->pbase + ((long) pg) * Poolpage + pp->pgcarved * bsize;
+	    pp->pgcarved++;
+	}
+	pp->pgmap |= 1ULL << ((bp - pool->pbase) % Poolpage / bsize);
+	if (++pp->pgused == Poolpage / bsize)
+	    pgunlink(c + 1, pg);      /* Page full */
+    }
+    pool->pblocks++;
+    if ((pool->pbytes += bsize) > pool->pmax)
+	pool->pmax = pool->pbytes;
+    return bp;
+}
+
+/*  POOLFIND  --  Return the page of a block in use and its length, or
+		  Pgnil if bp isn't the address of one.  */
+
+static int poolfind(bp, bsize)
+  char *bp;
+  long *bsize;
+{
+    poolpage *pp;
+    long off;
+    int pg;
+
+    if (pool == NULL || bp < pool->pbase ||
+	bp >= pool->pbase + ((long) pool->pnpages) * Poolpage)
+	return Pgnil;
+    off = bp - pool->pbase;
+    pg = off / Poolpage;
+    off %= Poolpage;
+    pp = &pool->ppage[pg];
+    if (pp->pgclass == Pgrun) {
+	*bsize = ((long) pp->pgused) * Poolpage;
+	return (off == 0) ? pg : Pgnil;
+    }
+    if (pp->pgclass >= Poolclasses)
+	return Pgnil;
+    *bsize = Poolmin << pp->pgclass;
+    if ((off % *bsize) != 0 || !(pp->pgmap & (1ULL << (off / *bsize))))
+	return Pgnil;
+    return pg;
+}
+
+/*  POOLFREE  --  Release a block poolfind() has vouched for.  */
+
+static void poolfree(bp, pg, bsize)
+  char *bp;
+  int pg;
+  long bsize;
+{
+    poolpage *pp = &pool->ppage[pg];
+    int i;
+
+    if (pp->pgclass == Pgrun) {
+	for (i = pg + pp->pgused - 1; i >= pg; i--) {
+	    pool->ppage[i].pgclass = Pgfree;
+	    pglink(0, i);
+	}
+	pool->pnfree += pp->pgused;
+    } else {
+	i = pp->pgclass + 1;
+	pp->pgmap &= ~(1ULL << ((bp - pool->pbase) % Poolpage / bsize));
+	*((char **) bp) = pp->pgfree;
+	pp->pgfree = bp;
+	if (pp->pgused-- == Poolpage / bsize)
+	    pglink(i, pg);	      /* Was full: has a block to spare */
+	if (pp->pgused == 0) {
+	    pgunlink(i, pg);	      /* All free: back to the unused pages */
+	    pp->pgclass = Pgfree;
+	    pglink(0, pg);
+	    pool->pnfree++;
+	}
+    }
+    pool->pblocks--;
+    pool->pbytes -= bsize;
+}
+
+prim P_allocate()		      /* Allocate dynamic memory */
+{				      /* u -- addr ior */
+    char *bp;
+
+    Sl(1);
+    So(1);
+    bp = poolalloc(S0);
+    S0 = (stackitem) bp;
+    Push = (bp == NULL) ? Ior_allocate : 0;
+}
+
+prim P_free()			      /* Release dynamic memory */
+{				      /* addr -- ior */
+    long bsize;
+    int pg;
+
+    Sl(1);
+    if ((pg = poolfind((char *) S0, &bsize)) == Pgnil) {
+	S0 = Ior_free;
+    } else {
+	poolfree((char *) S0, pg, bsize);
+	S0 = 0;
+    }
+}
+
+prim P_resize() 		      /* Change length of dynamic memory */
+{				      /* addr u -- addr' ior */
+    long bsize;
+    char *bp;
+    int pg;
+
+    Sl(2);
+    if ((pg = poolfind((char *) S1, &bsize)) == Pgnil || !poolfits(S0)) {
+	S0 = Ior_resize;
+    } else if (poolsize(S0) == bsize) {
+	S0 = 0; 		      /* Same size of block: stays put */
+    } else if ((bp = poolalloc(S0)) == NULL) {
+	S0 = Ior_resize;	      /* Original block is left as it was */
+    } else {
+	V memcpy(bp, (char *) S1, (size_t) min(bsize, poolsize(S0)));
+	poolfree((char *) S1, pg, bsize);
+	S1 = (stackitem) bp;
+	S0 = 0;
+    }
+}
+#endif /* MEMPOOL */
+
 /*  Variable and constant primitives  */
 
 prim P_var()			      /* Push body address of current word */
@@ -949,6 +2300,10 @@ Exported void P_create()	      /* Create new word */
     createword->wname = NULL;	      /* Clear pointer to name string */
     createword->wcode = P_var;	      /* Store default code */
     hptr += Dictwordl;		      /* Allocate heap space for word */
+#ifdef TOKTHREAD
+    tokhptr = NULL;		      /* Start its code in a new cell */
+#endif
+    Peepfence;
 }
 
 prim P_forget() 		      /* Forget word */
@@ -956,6 +2311,41 @@ prim P_forget() 		      /* Forget word */
     forgetpend = True;		      /* Mark forget pending */
 }
 
+/*  A marker word is its own record of the state to return to: its
+    item is where the heap stood before it was created, its link is
+    the dictionary before it, and its name is the last allocated
+    from the name arena.  Executing it forgets it and everything
+    defined after it without looking up or walking past a single
+    word it keeps.  With the name arena and no hash index this
+    takes constant time; with HASHDICT, dictcut() still unhooks
+    each word forgotten from its hash chain.  */
+
+prim P_domarker()		      /* Roll back to before this marker */
+{
+    dictword *dw = curword, *odict = dict;
+
+    if (!userword(dw)) {
+#ifdef MEMMESSAGE
+        V printf("\nForget protected.\n");
+#endif
+	evalstat = ATL_FORGETPROT;
+	return;
+    }
+    dictcut(dw->wnext);
+#ifdef NAMEARENA
+    heaptop = ((stackitem *) dw->wname) +
+	(strlen(dw->wname + 1) + 1 + sizeof(stackitem)) / sizeof(stackitem);
+#endif
+    hptr = (stackitem *) dw;
+    heapcut(odict);
+}
+
+prim P_marker() 		      /* Declare marker */
+{
+    P_create(); 		      /* Create dictionary item */
+    createword->wcode = P_domarker;   /* Set code to roll back */
+}
+
 prim P_variable()		      /* Declare variable */
 {
     P_create(); 		      /* Create dictionary item */
@@ -1067,6 +2457,7 @@ prim P_array()			      /* Declare array */
 prim P_strlit() 		      /* Push address of string literal */
 {
     So(1);
+    ip = Ipalign(ip);
     Push = (stackitem) (((char *) ip) + 1);
 #ifdef TRACE
     if (atl_trace) {
@@ -1164,11 +2555,14 @@ prim P_strform()		      /* Format integer using sprintf() */
 #ifdef REAL
 prim P_fstrform()		      /* Format real using sprintf() */
 {                                     /* rvalue "%6.2f" str -- */
-    Sl(4);
+    atl_real r;
+
+    Sl(2 + Realsize);
     Hpc(S0);
     Hpc(S1);
-    V sprintf((char *) S0, (char *) S1, REAL1);
-    Npop(4);
+    V memcpy((char *) &r, (char *) (stk - 2 - Realsize), sizeof(atl_real));
+    V sprintf((char *) S0, (char *) S1, Rtod(r));
+    Npop(2 + Realsize);
 }
 #endif /* REAL */
 
@@ -1196,45 +2590,237 @@ prim P_strreal()		      /* String to real */
     char *eptr;
 
     Sl(1);
-    So(2);
+    So(Realsize);
     Hpc(S0);
-    fsu.fs = strtod((char *) S0, &eptr);
+    fsu.fss[Realsize - 1] = 0;
+    fsu.fs = Dtor(strtod((char *) S0, &eptr));
     S0 = (stackitem) eptr;
     for (i = 0; i < Realsize; i++) {
     	Push = fsu.fss[i];
     }
 }
 #endif /* REAL */
-#endif /* STRING */
 
-/*  Floating point primitives  */
+/*  Counted strings.  A slice is a string given by its address and
+    length on the stack, which needn't be terminated, so a substring
+    is just a narrower slice of the same storage.  A counted string
+    buffer, made by CSTRING, holds its capacity and current length in
+    the two cells before its text, so its length is known without a
+    scan and appending to it never runs past its end: text that
+    doesn't fit is dropped.  The text is kept NUL-terminated as well,
+    so CS>STR can hand it to the C string words.  */
 
-#ifdef REAL
+#define Csmax(p)    (((stackitem *) (p))[0]) /* Capacity */
+#define Cslen(p)    (((stackitem *) (p))[1]) /* Length */
+#define Cstext(p)   ((char *) (((stackitem *) (p)) + 2)) /* Text */
 
-prim P_flit()			      /* Push floating point literal */
+/* Check a counted string buffer, and a slice of n characters. */
+
+#define Cspc(p)     Hpc(p); Hpc(Cstext(p) + Csmax(p))
+#define Slpc(a, n)  if ((n) > 0) { Hpc(a); Hpc(((char *) (a)) + (n) - 1); }
+
+/*  CSPUT  --  Store a slice into a counted string buffer at a given
+	       position, as much of it as fits.  */
+
+static void csput(cs, at, a, n)
+  stackitem *cs;
+  stackitem at;
+  char *a;
+  stackitem n;
 {
-    int i;
+    if (n > Csmax(cs) - at)
+	n = Csmax(cs) - at;
+    if (n < 0)
+	n = 0;
+    V memmove(Cstext(cs) + at, a, (size_t) n); /* May be a slice of it */
+    Cslen(cs) = at + n;
+    Cstext(cs)[at + n] = EOS;
+}
 
-    So(Realsize);
-#ifdef TRACE
-    if (atl_trace) {
-	atl_real tr;
+prim P_cstring()		      /* Create counted string buffer */
+{				      /* n -- */
+    stackitem l;
 
-	V memcpy((char *) &tr, (char *) ip, sizeof(atl_real));
-        V printf("%g ", tr);
+    Sl(1);
+#ifndef NOMEMCHECK
+    if (S0 < 0) {		      /* Would move the heap back */
+	evalstat = ATL_HEAPOVER;
+	trouble("Bad string length");
+	return;
     }
-#endif /* TRACE */
-    for (i = 0; i < Realsize; i++) {
-	Push = (stackitem) *ip++;
+    if (S0 > (heaptop - hptr) * (stackitem) sizeof(stackitem)) {
+	heapover();		      /* Refuse before rounding can overflow */
+	return;
     }
+#endif /* NOMEMCHECK */
+    l = 2 + (S0 + sizeof(stackitem)) / sizeof(stackitem);
+    Ho(l);
+    P_create(); 		      /* Create variable */
+    Ho(l);
+    hptr[0] = S0;		      /* Capacity */
+    hptr[1] = 0;		      /* Empty */
+    *((char *) (hptr + 2)) = EOS;
+    hptr += l;
+    Pop;
 }
 
-prim P_fplus()			      /* Add floating point numbers */
-{
-    Sl(2 * Realsize);
-    SREAL1(REAL1 + REAL0);
-    Realpop;
-}
+prim P_csat()			      /* Counted string to slice */
+{				      /* cs -- addr n */
+    stackitem n;
+
+    Sl(1);
+    So(1);
+    Cspc(S0);
+    n = Cslen(S0);
+    Push = n;
+    S1 = (stackitem) Cstext(S1);
+}
+
+prim P_cslen()			      /* Length of counted string */
+{				      /* cs -- n */
+    Sl(1);
+    Cspc(S0);
+    S0 = Cslen(S0);
+}
+
+prim P_cstostr()		      /* Counted string to C string */
+{				      /* cs -- str */
+    Sl(1);
+    Cspc(S0);
+    S0 = (stackitem) Cstext(S0);
+}
+
+prim P_csbang() 		      /* Store slice in counted string */
+{				      /* addr n cs -- */
+    Sl(3);
+    Cspc(S0);
+    Slpc(S2, S1);
+    csput((stackitem *) S0, 0, (char *) S2, S1);
+    Npop(3);
+}
+
+prim P_csplus() 		      /* Append slice to counted string */
+{				      /* addr n cs -- */
+    Sl(3);
+    Cspc(S0);
+    Slpc(S2, S1);
+    csput((stackitem *) S0, Cslen(S0), (char *) S2, S1);
+    Npop(3);
+}
+
+prim P_cscplus()		      /* Append character to counted string */
+{				      /* c cs -- */
+    char c;
+
+    Sl(2);
+    Cspc(S0);
+    c = (char) S1;
+    csput((stackitem *) S0, Cslen(S0), &c, 1);
+    Pop2;
+}
+
+prim P_csform() 		      /* Append formatted integer */
+{				      /* value "%ld" cs -- */
+    stackitem *cs;
+    int n;
+
+    Sl(3);
+    Cspc(S0);
+    Hpc(S1);
+    cs = (stackitem *) S0;
+    n = snprintf(Cstext(cs) + Cslen(cs), (size_t) (Csmax(cs) - Cslen(cs) + 1),
+	(char *) S1, S2);
+    if (n > 0)
+	Cslen(cs) += min(n, Csmax(cs) - Cslen(cs));
+    Npop(3);
+}
+
+prim P_strtoslice()		      /* C string to slice */
+{				      /* str -- addr n */
+    stackitem n;
+
+    Sl(1);
+    So(1);
+    Hpc(S0);
+    n = strlen((char *) S0);
+    Push = n;
+}
+
+prim P_slice()			      /* Narrow a slice */
+{				      /* addr n start length/-1 -- addr n */
+    stackitem n, start, len;
+
+    Sl(4);
+    n = S2;
+    start = S1;
+    len = S0;
+    if (start < 0)
+	start = 0;
+    if (start > n)
+	start = n;
+    if (len < 0 || len > n - start)
+	len = n - start;
+    S3 += start;
+    S2 = len;
+    Pop2;
+}
+
+prim P_stype()			      /* Print slice */
+{				      /* addr n -- */
+    Sl(2);
+    Slpc(S1, S0);
+    if (S0 > 0)
+	V printf("%.*s", (int) S0, (char *) S1);
+    Pop2;
+}
+
+prim P_scompare()		      /* Compare slices */
+{				      /* addr1 n1 addr2 n2 -- -1/0/1 */
+    stackitem n;
+    int i;
+
+    Sl(4);
+    Slpc(S3, S2);
+    Slpc(S1, S0);
+    n = min(S2, S0);
+    i = (n > 0) ? memcmp((char *) S3, (char *) S1, (size_t) n) : 0;
+    if (i == 0)
+	i = (S2 > S0) - (S2 < S0);
+    S3 = (i == 0) ? 0L : ((i > 0) ? 1L : -1L);
+    Npop(3);
+}
+#endif /* STRING */
+
+/*  Floating point primitives  */
+
+#ifdef REAL
+
+prim P_flit()			      /* Push floating point literal */
+{
+    int i;
+
+    So(Realsize);
+#ifdef TRACE
+    if (atl_trace) {
+	atl_real tr;
+
+	V memcpy((char *) &tr, (char *) Ipalign(ip), sizeof(atl_real));
+        V printf("%g ", Rtod(tr));
+    }
+#endif /* TRACE */
+    ip = Ipalign(ip);
+    for (i = 0; i < Realsize; i++) {
+	Push = *((stackitem *) ip);
+	ip += Tokcell;
+    }
+}
+
+prim P_fplus()			      /* Add floating point numbers */
+{
+    Sl(2 * Realsize);
+    SREAL1(REAL1 + REAL0);
+    Realpop;
+}
 
 prim P_fminus() 		      /* Subtract floating point numbers */
 {
@@ -1246,7 +2832,7 @@ prim P_fminus() 		      /* Subtract floating point numbers */
 prim P_ftimes() 		      /* Multiply floating point numbers */
 {
     Sl(2 * Realsize);
-    SREAL1(REAL1 * REAL0);
+    SREAL1(Rmul(REAL1, REAL0));
     Realpop;
 }
 
@@ -1259,7 +2845,7 @@ prim P_fdiv()			      /* Divide floating point numbers */
 	return;
     }
 #endif /* NOMEMCHECK */
-    SREAL1(REAL1 / REAL0);
+    SREAL1(Rdiv(REAL1, REAL0));
     Realpop;
 }
 
@@ -1352,7 +2938,7 @@ prim P_fleq()			      /* Test less than or equal */
 prim P_fdot()			      /* Print floating point top of stack */
 {
     Sl(Realsize);
-    V printf("%g ", REAL0);
+    V printf("%g ", Rtod(REAL0));
     Realpop;
 }
 
@@ -1362,7 +2948,7 @@ prim P_float()			      /* Convert integer to floating */
 
     Sl(1)
     So(Realsize - 1);
-    r = S0;
+    r = Itor(S0);
     stk += Realsize - 1;
     SREAL0(r);
 }
@@ -1372,14 +2958,23 @@ prim P_fix()			      /* Convert floating to integer */
     stackitem i;
 
     Sl(Realsize);
-    i = (int) REAL0;
+    i = Rtoi(REAL0);
     Realpop;
     Push = i;
 }
 
 #ifdef MATH
 
-#define Mathfunc(x) Sl(Realsize); SREAL0(x(REAL0))
+/*  Single precision reals use the float versions of the library
+    functions; fixed point reals are converted to and from double
+    except for square root.  */
+
+#ifdef REALFLOAT
+#define Mathfn(x)   x##f
+#else
+#define Mathfn(x)   x
+#endif
+#define Mathfunc(x) Sl(Realsize); SREAL0(Dtor(Mathfn(x)(Rtod(REAL0))))
 
 prim P_acos()			      /* Arc cosine */
 {
@@ -1399,7 +2994,7 @@ prim P_atan()			      /* Arc tangent */
 prim P_atan2()			      /* Arc tangent:  y x -- atan */
 {
     Sl(2 * Realsize);
-    SREAL1(atan2(REAL1, REAL0));
+    SREAL1(Dtor(Mathfn(atan2)(Rtod(REAL1), Rtod(REAL0))));
     Realpop;
 }
 
@@ -1421,7 +3016,7 @@ prim P_log()			      /* Natural log */
 prim P_pow()			      /* X ^ Y */
 {
     Sl(2 * Realsize);
-    SREAL1(pow(REAL1, REAL0));
+    SREAL1(Dtor(Mathfn(pow)(Rtod(REAL1), Rtod(REAL0))));
     Realpop;
 }
 
@@ -1432,7 +3027,33 @@ prim P_sin()			      /* Sine */
 
 prim P_sqrt()			      /* Square root */
 {
+#ifdef REALFIXED
+    unsigned long long v, b, q = 0;
+
+    Sl(Realsize);
+    if (REAL0 <= 0) {
+	SREAL0(0);
+	return;
+    }
+
+    /* Integer square root of the value scaled up by the fraction, one
+       result bit per step, so the result is again fixed point. */
+
+    v = ((unsigned long long) REAL0) << Rfrac;
+    for (b = 1ULL << 62; b > v; b >>= 2) ;
+    while (b != 0) {
+	if (v >= q + b) {
+	    v -= q + b;
+	    q = (q >> 1) + b;
+	} else {
+	    q >>= 1;
+	}
+	b >>= 2;
+    }
+    SREAL0((atl_real) q);
+#else
     Mathfunc(sqrt);
+#endif
 }
 
 prim P_tan()			      /* Tangent */
@@ -1440,6 +3061,7 @@ prim P_tan()			      /* Tangent */
     Mathfunc(tan);
 }
 #undef Mathfunc
+#undef Mathfn
 #endif /* MATH */
 #endif /* REAL */
 
@@ -1485,7 +3107,7 @@ prim P_dotquote()		      /* Print literal string that follows */
 {
     Compiling;
     stringlit = True;		      /* Set string literal expected */
-    Compconst(s_dotparen);	      /* Compile .( word */
+    Compword(s_dotparen);	      /* Compile .( word */
 }
 
 prim P_dotparen()		      /* Print literal string that follows */
@@ -1493,6 +3115,7 @@ prim P_dotparen()		      /* Print literal string that follows */
     if (ip == NULL) {		      /* If interpreting */
 	stringlit = True;	      /* Set to print next string constant */
     } else {			      /* Otherwise, */
+	ip = Ipalign(ip);
         V printf("%s", ((char *) ip) + 1); /* print string literal
 					 in in-line code. */
 	Skipstring;		      /* And advance IP past it */
@@ -1512,12 +3135,21 @@ prim P_words()			      /* List words */
 #ifndef Keyhit
     int key = 0;
 #endif
+#ifdef ROMDICT
+    dictword *dw = dictnext(NULL);
+#else
     dictword *dw = dict;
+#endif
 
     while (dw != NULL) {
 
-        V printf("\n%s", dw->wname + 1);
+	if (!(dw->wname[0] & WORDHIDDEN))
+            V printf("\n%s", dw->wname + 1);
+#ifdef ROMDICT
+	dw = dictnext(dw);
+#else
 	dw = dw->wnext;
+#endif
 #ifdef Keyhit
 	if (kbquit()) {
 	    break;
@@ -1677,6 +3309,23 @@ prim P_fload()			      /* Load source file:  fd -- evalstat */
     So(1);
     Push = estat;
 }
+
+prim P_include()		      /* Include file:  name -- evalstat */
+{
+    char fname[128];		      /* The string may be overwritten */
+    int estat = ATL_NOFILE;
+
+    Sl(1);
+    Hpc(S0);
+    if (strlen((char *) S0) < sizeof fname) {
+	V strcpy(fname, (char *) S0);
+	Pop;
+	estat = atl_include(fname);
+    } else
+	Pop;
+    So(1);
+    Push = estat;
+}
 #endif /* FILEIO */
 
 #ifdef EVALUATE
@@ -1686,19 +3335,53 @@ prim P_evaluate()
     int es = ATL_SNORM;
     atl_statemark mk;
     atl_int scomm = atl_comment;      /* Stack comment pending state */
-    dictword **sip = ip;	      /* Stack instruction pointer */
+    atl_token *sip = ip;	      /* Stack instruction pointer */
     char *sinstr = instream;	      /* Stack input stream */
     char *estring;
+#ifdef RSWALKBACK
+    atl_wblevel lv;
+#endif
+#ifdef CATCH
+    atl_catch cf;
+#endif
 
     Sl(1);
     Hpc(S0);
     estring = (char *) S0;	      /* Get string to evaluate */
     Pop;			      /* Pop so it sees arguments below it */
     atl_mark(&mk);		      /* Mark in case of error */
+#ifdef CATCH
+    /* A THROW to a CATCH outside unwinds what the string defined,
+       as an error does, on its way.  */
+    if (catchp != NULL) {
+	catchsave(&cf);
+	if (setjmp(cf.cjmp) != 0) {
+	    stackitem n = S0;
+
+	    atl_unwind(&mk);
+	    throwcode(n);
+	}
+	catchp = &cf;
+    }
+#endif
+#ifdef RSWALKBACK
+    lv.lprev = wblevel; 	      /* Note where our caller had reached */
+    lv.lword = NULL;
+    lv.lip = sip;
+    lv.lrstk = rstk;
+    wblevel = &lv;
+#endif
     ip = NULL;			      /* Fool atl_eval into interp state */
     if ((es = atl_eval(estring)) != ATL_SNORM) {
 	atl_unwind(&mk);
     }
+#ifdef CATCH
+    if (catchp == &cf)
+	catchp = cf.cprev;
+#endif
+#ifdef RSWALKBACK
+    wblevel = lv.lprev;
+#endif
     /* If there were no other errors, check for a runaway comment.  If
        we ended the file in comment-ignore mode, set the runaway comment
        error status and unwind the file.  */
@@ -1714,6 +3397,255 @@ prim P_evaluate()
 }
 #endif /* EVALUATE */
 
+#ifdef TASKS
+
+/*  Cooperative multitasking.  Each task has its own data stack, return
+    stack and instruction pointer, and shares the heap and dictionary
+    with the others.  The tasks, including the foreground one in which
+    atl_eval() runs, form a ring; PAUSE passes control to the next task
+    in the ring by exchanging the interpreter's stack and instruction
+    pointers, so exword() simply carries on with the next task's code.
+
+    A background task only switches at the level of atl_eval() or
+    atl_exec() at which it was started, since an inner level has C
+    state of its own.  PAUSE within an EVALUATE in a background task
+    does nothing.  The foreground can pause at any level, because the
+    other tasks always come back to it.  */
+
+/*  TASKSAVE  --  Save the interpreter pointers in a task.  */
+
+static void tasksave(t)
+  atl_task *t;
+{
+    t->tstack = stack;
+    t->tstk = stk;
+    t->tstacktop = stacktop;
+    t->trstack = rstack;
+    t->trstk = rstk;
+    t->trstacktop = rstacktop;
+    t->tip = ip;
+#ifdef WBSTACK
+    t->twback = wback;
+    t->twbptr = wbptr;
+#endif
+#ifdef CATCH
+    t->tcatch = catchp;
+#endif
+#ifdef MEMSTAT
+    t->tstackmax = stackmax;
+    t->trstackmax = rstackmax;
+#endif
+}
+
+/*  TASKLOAD  --  Make a task the running one.  */
+
+static void taskload(t)
+  atl_task *t;
+{
+    stack = stackbot = t->tstack;
+    stk = t->tstk;
+    stacktop = t->tstacktop;
+    rstack = rstackbot = t->trstack;
+    rstk = t->trstk;
+    rstacktop = t->trstacktop;
+    ip = t->tip;
+#ifdef WBSTACK
+    wback = t->twback;
+    wbptr = t->twbptr;
+#endif
+#ifdef CATCH
+    catchp = t->tcatch;
+#endif
+#ifdef MEMSTAT
+    stackmax = t->tstackmax;
+    rstackmax = t->trstackmax;
+#endif
+    curtask = t;
+}
+
+/*  TASKEXIT  --  Called when exword() runs out of code.  If it was a
+		  background task that finished, remove it from the
+		  ring and switch to the next task, returning True so
+		  exword() carries on.	An error ends only the task in
+		  which it occurred, which has already reported it. */
+
+static Boolean taskexit()
+{
+    atl_task *t = curtask, *pt;
+
+    if (t == fgtask || evaldepth != taskdepth)
+	return False;
+    for (pt = t; pt->tnext != t; pt = pt->tnext) ;
+    pt->tnext = t->tnext;
+    taskload(t->tnext);
+    free((char *) t);
+    if (evalstat != ATL_BREAK)
+	evalstat = ATL_SNORM;
+    return True;
+}
+
+/*  TASKKILL  --  Return to the foreground and end all other tasks.  */
+
+static void taskkill()
+{
+    atl_task *t;
+
+    if (fgtask != NULL) {
+	if (curtask != fgtask)
+	    taskload(fgtask);
+	while ((t = fgtask->tnext) != fgtask) {
+	    fgtask->tnext = t->tnext;
+	    free((char *) t);
+	}
+    }
+}
+
+prim P_pause()			      /* Run the next task */
+{
+    if (curtask == NULL || curtask->tnext == curtask)
+	return; 		      /* No other task to run */
+    if (curtask == fgtask)
+	taskdepth = evaldepth;	      /* Tasks run at this level */
+    else if (evaldepth != taskdepth)
+	return; 		      /* Within EVALUATE or atl_exec() */
+    tasksave(curtask);
+    taskload(curtask->tnext);
+}
+
+prim P_task()			      /* Start task:  word -- task */
+{
+    atl_task *t;
+
+    Sl(1);
+    if (fgtask == NULL) {
+	if ((fgtask = (atl_task *) malloc(sizeof(atl_task))) == NULL) {
+	    S0 = 0;
+	    return;
+	}
+	fgtask->tnext = curtask = fgtask;
+	fgtask->tid = 0;
+	fgtask->tpaused = False;
+    }
+    t = (atl_task *) malloc(sizeof(atl_task) +
+	    Tstklen * sizeof(stackitem) + Trstklen * sizeof(rstackitem)
+#ifdef WBSTACK
+	    + Trstklen * sizeof(dictword *)
+#endif
+	    );
+    if (t == NULL) {
+	S0 = 0; 		      /* No memory for the task */
+	return;
+    }
+    t->tstack = t->tstk = (stackitem *) (t + 1);
+    t->tstacktop = t->tstack + Tstklen;
+    t->trstack = t->trstk = (rstackitem *) t->tstacktop;
+    t->trstacktop = t->trstack + Trstklen;
+    *t->trstk++ = NULL; 	      /* Returning from its word ends it */
+    t->tcode[0] = Wordtok((dictword *) S0);
+    t->tcode[1] = Wordtok((dictword *) s_exit);
+    t->tip = t->tcode;
+#ifdef WBSTACK
+    t->twback = t->twbptr = (dictword **) t->trstacktop;
+#endif
+#ifdef CATCH
+    t->tcatch = NULL;
+#endif
+#ifdef MEMSTAT
+    t->tstackmax = t->tstack;
+    t->trstackmax = t->trstk;
+#endif
+    t->tpaused = False;
+    t->tid = ++taskseq;
+
+    /* Link the task in just before the foreground, so tasks get their
+       turns in the order they were started. */
+
+    t->tnext = fgtask;
+    {
+	atl_task *pt;
+
+	for (pt = fgtask; pt->tnext != fgtask; pt = pt->tnext) ;
+	pt->tnext = t;
+    }
+    S0 = t->tid;
+}
+
+/*  TASKEND  --  End background task t, which follows pt in the ring.
+		 The running task can't be freed beneath exword(), so
+		 its code is cut short and taskexit() removes it.  */
+
+static void taskend(pt, t)
+  atl_task *pt, *t;
+{
+    if (t == curtask) {
+	rstk = rstack;		      /* Ends when exword() runs out of code */
+#ifdef WBSTACK
+	wbptr = wback;
+#endif
+	ip = NULL;
+    } else {
+	pt->tnext = t->tnext;
+	free((char *) t);
+    }
+}
+
+/*  TASKSTALE  --  Test whether a code pointer lies in the heap past
+		   hptr, which FORGET, a marker or atl_unwind() has
+		   just released.  */
+
+static Boolean taskstale(p)
+  atl_token *p;
+{
+    return (((stackitem *) p) >= hptr && ((stackitem *) p) < heaptop) ?
+	True : False;
+}
+
+/*  TASKCUT  --  Called once the heap has been cut back to hptr.  Ends
+		 every background task whose word, instruction pointer
+		 or saved return stack lies in the space released, as
+		 it would otherwise go on running code which is about
+		 to be overwritten.  Tasks running only words that
+		 remain carry on.  */
+
+static void taskcut()
+{
+    atl_task *t, *pt;
+
+    if (fgtask == NULL)
+	return;
+    for (pt = fgtask; (t = pt->tnext) != fgtask; ) {
+	Boolean running = (t == curtask) ? True : False;
+	rstackitem *rp = running ? rstack : t->trstack,
+		   *rtop = running ? rstk : t->trstk;
+	Boolean stale = (taskstale((atl_token *) Tokword(t->tcode[0])) ||
+	    taskstale(running ? ip : t->tip)) ? True : False;
+
+	for (; !stale && rp < rtop; rp++)
+	    stale = taskstale(*rp);
+	if (stale)
+	    taskend(pt, t);
+	if (pt->tnext == t)
+	    pt = t;		      /* Kept, or running until taskexit() */
+    }
+}
+
+prim P_stop()			      /* Stop task:  task -- */
+{
+    atl_task *t, *pt;
+
+    Sl(1);
+    if (fgtask != NULL) {
+	for (pt = fgtask; (t = pt->tnext) != fgtask; pt = t) {
+	    if (t->tid == S0) {
+		taskend(pt, t);
+		break;
+	    }
+	}
+    }
+    Pop;
+}
+#endif /* TASKS */
+
 /*  Stack mechanics  */
 
 prim P_depth()			      /* Push stack depth */
@@ -1929,7 +3861,7 @@ prim P_2bang()			      /* Store double value into address */
 {
     stackitem *sp;
 
-    Sl(2);
+    Sl(3);
     Hpc(S0);
     sp = (stackitem *) S0;
     *sp++ = S2;
@@ -1955,115 +3887,275 @@ prim P_2at()			      /* Fetch double value from address */
 prim P_dolit()			      /* Push instruction stream literal */
 {
     So(1);
+    ip = Ipalign(ip);
 #ifdef TRACE
     if (atl_trace) {
-        V printf("%ld ", (long) *ip);
+        V printf("%ld ", (long) *((stackitem *) ip));
     }
 #endif
-    Push = (stackitem) *ip++;	      /* Push the next datum from the
+    Push = *((stackitem *) ip);       /* Push the next datum from the
 					 instruction stream. */
+    ip += Tokcell;
+}
+
+#ifdef TOKTHREAD
+prim P_doslit() 		      /* Push short in-line literal */
+{
+    So(1);
+#ifdef TRACE
+    if (atl_trace) {
+        V printf("%ld ", (long) Ipoff);
+    }
+#endif
+    Push = Ipoff;
+    ip++;
 }
+#endif /* TOKTHREAD */
 
 /*  Control flow primitives  */
 
 prim P_nest()			      /* Invoke compiled word */
 {
     Rso(1);
-#ifdef WALKBACK
+#ifdef WBSTACK
     *wbptr++ = curword; 	      /* Place word on walkback stack */
 #endif
     Rpush = ip; 		      /* Push instruction pointer */
-    ip = (((dictword **) curword) + Dictwordl);
+    ip = (atl_token *) (((stackitem *) curword) + Dictwordl);
+    Profnest();
 }
 
 prim P_exit()			      /* Return to top of return stack */
 {
     Rsl(1);
-#ifdef WALKBACK
+#ifdef WBSTACK
     wbptr = (wbptr > wback) ? wbptr - 1 : wback;
 #endif
     ip = R0;			      /* Set IP to top of return stack */
     Rpop;
+    Profexit();
+}
+
+#ifdef VERIFY
+
+/*  A verified definition's code is preceded by a cell giving its
+    effect on the stacks: the depth it needs on entry, the most it
+    pushes above that, the return stack items it pushes, including
+    the return address, and its net effect on the stack depth.  */
+
+#define Fxpack(need, grow, rgrow, net) ((stackitem) ((unsigned long) \
+		(need) | ((unsigned long) (grow) << 8) | \
+		((unsigned long) (rgrow) << 16) | \
+		((unsigned long) ((net) + 128) << 24)))
+#define Fxneed(fx)  ((int) ((fx) & 0xFF))
+#define Fxgrow(fx)  ((int) (((fx) >> 8) & 0xFF))
+#define Fxrgrow(fx) ((int) (((fx) >> 16) & 0xFF))
+#define Fxnet(fx)   ((int) (((fx) >> 24) & 0xFF) - 128)
+
+prim P_vnest()			      /* Invoke verified compiled word */
+{
+    stackitem fx = *(((stackitem *) curword) + Dictwordl);
+
+    Sl(Fxneed(fx));		      /* One check of both stacks covers */
+    So(Fxgrow(fx));		      /* everything the word does */
+    Rso(Fxrgrow(fx));
+#ifdef WBSTACK
+    *wbptr++ = curword; 	      /* Place word on walkback stack */
+#endif
+    Rpush = ip; 		      /* Push instruction pointer */
+    ip = (atl_token *) (((stackitem *) curword) + Dictwordl + 1);
+    Profnest();
+}
+#endif /* VERIFY */
+
+#ifdef TAILCALL
+
+/*  A call of a definition followed by EXIT is compiled as (TAIL) and
+    the word, which returns and then runs the word.  When the word is a
+    definition, its code simply takes the place of ours, reusing our
+    return address.  A word so called sees the return stack without
+    its caller's return address, so one which reaches into its caller's
+    frame with R> must not be called last.  */
+
+prim P_tail()			      /* Return, then execute in-line word */
+{
+    curword = Tokword(*ip);
+#ifdef TRACE
+    if (atl_trace) {
+        V printf("%s ", curword->wname + 1);
+    }
+#endif
+    Profword();
+    if (curword->wcode == P_nest) {
+	ip = (atl_token *) (((stackitem *) curword) + Dictwordl);
+#ifdef VERIFY
+    } else if (curword->wcode == P_vnest) {
+	stackitem fx = *(((stackitem *) curword) + Dictwordl);
+
+	Sl(Fxneed(fx));
+	So(Fxgrow(fx));
+	Rso(Fxrgrow(fx) - 1);	      /* Our return address is reused */
+	ip = (atl_token *) (((stackitem *) curword) + Dictwordl + 1);
+#endif
+    } else {
+	P_exit();		      /* Not a definition: return and */
+	(*curword->wcode)();	      /* run it as it is */
+	return;
+    }
+#ifdef WBSTACK
+    if (wbptr > wback)
+	wbptr[-1] = curword;	      /* It replaces us in the walkback */
+#endif
+    Proftail();
 }
+#endif /* TAILCALL */
 
 prim P_branch() 		      /* Jump to in-line address */
 {
-    ip += (stackitem) *ip;	      /* Jump addresses are IP-relative */
+    ip += Ipoff;		      /* Jump addresses are IP-relative */
 }
 
 prim P_qbranch()		      /* Conditional branch to in-line addr */
 {
     Sl(1);
     if (S0 == 0)		      /* If flag is false */
-	ip += (stackitem) *ip;	      /* then branch. */
+	ip += Ipoff;		      /* then branch. */
     else			      /* Otherwise */
 	ip++;			      /* skip the in-line address. */
     Pop;
 }
 
-prim P_if()			      /* Compile IF word */
+#ifdef PEEPHOLE
+
+/*  Superinstructions the peephole optimiser compiles in place of
+    common sequences of words, each doing the work of the sequence
+    in one dispatch.  */
+
+prim P_litplus()		      /* Add in-line literal: (LIT) n + */
 {
-    Compiling;
-    Compconst(s_qbranch);	      /* Compile question branch */
-    So(1);
-    Push = (stackitem) hptr;	      /* Save backpatch address on stack */
-    Compconst(0);		      /* Compile place-holder address cell */
+    Sl(1);
+    S0 += Ipoff;		      /* Same operand as (SLIT), or (LIT) */
+    ip++;			      /* when tokens are cells */
 }
 
-prim P_else()			      /* Compile ELSE word */
+prim P_litat()			      /* Fetch from in-line address: a @ */
 {
-    stackitem *bp;
+    stackitem *vp;
 
-    Compiling;
-    Sl(1);
-    Compconst(s_branch);	      /* Compile branch around other clause */
-    Compconst(0);		      /* Compile place-holder address cell */
-    Hpc(S0);
-    bp = (stackitem *) S0;	      /* Get IF backpatch address */
-    *bp = hptr - bp;
-    S0 = (stackitem) (hptr - 1);      /* Update backpatch for THEN */
+    So(1);
+    ip = Ipalign(ip);
+    vp = *((stackitem **) ip);
+    Hpc(vp);
+    Push = *vp;
+    ip += Tokcell;
 }
 
-prim P_then()			      /* Compile THEN word */
+prim P_litbang()		      /* Store at in-line address: a ! */
 {
-    stackitem *bp;
+    stackitem *vp;
 
-    Compiling;
     Sl(1);
-    Hpc(S0);
-    bp = (stackitem *) S0;	      /* Get IF/ELSE backpatch address */
-    *bp = hptr - bp;
+    ip = Ipalign(ip);
+    vp = *((stackitem **) ip);
+    Hpc(vp);
+    *vp = S0;
     Pop;
+    ip += Tokcell;
 }
 
-prim P_qdup()			      /* Duplicate if nonzero */
+prim P_dupqbranch()		      /* DUP ?BRANCH: branch if zero, keep */
 {
     Sl(1);
-    if (S0 != 0) {
-	stackitem s = S0;
-	So(1);
-	Push = s;
-    }
+    if (S0 == 0)
+	ip += Ipoff;
+    else
+	ip++;
 }
 
-prim P_begin()			      /* Compile BEGIN */
+prim P_zqbranch()		      /* 0= ?BRANCH: branch if nonzero */
 {
-    Compiling;
-    So(1);
-    Push = (stackitem) hptr;	      /* Save jump back address on stack */
+    Sl(1);
+    if (S0 != 0)
+	ip += Ipoff;
+    else
+	ip++;
+    Pop;
 }
 
-prim P_until()			      /* Compile UNTIL */
+prim P_iplus()			      /* I + */
 {
-    stackitem off;
-    stackitem *bp;
+    Rsl(3);
+    Sl(1);
+    S0 += (stackitem) R0;
+}
+#endif /* PEEPHOLE */
+
+prim P_if()			      /* Compile IF word */
+{
+    Compiling;
+    Compword(s_qbranch);	      /* Compile question branch */
+    So(1);
+    Push = (stackitem) Chere;	      /* Save backpatch address on stack */
+    Compconst(0);		      /* Compile place-holder address cell */
+}
+
+prim P_else()			      /* Compile ELSE word */
+{
+    atl_token *bp;
+
+    Compiling;
+    Sl(1);
+    Compword(s_branch);	      /* Compile branch around other clause */
+    Compconst(0);		      /* Compile place-holder address cell */
+    Hpc(S0);
+    bp = (atl_token *) S0;	      /* Get IF backpatch address */
+    *bp = (atl_token) (Chere - bp);
+    S0 = (stackitem) (Chere - 1);     /* Update backpatch for THEN */
+    Peepfence;
+}
+
+prim P_then()			      /* Compile THEN word */
+{
+    atl_token *bp;
+
+    Compiling;
+    Sl(1);
+    Hpc(S0);
+    bp = (atl_token *) S0;	      /* Get IF/ELSE backpatch address */
+    *bp = (atl_token) (Chere - bp);
+    Pop;
+    Peepfence;
+}
+
+prim P_qdup()			      /* Duplicate if nonzero */
+{
+    Sl(1);
+    if (S0 != 0) {
+	stackitem s = S0;
+	So(1);
+	Push = s;
+    }
+}
+
+prim P_begin()			      /* Compile BEGIN */
+{
+    Compiling;
+    So(1);
+    Push = (stackitem) Chere;	      /* Save jump back address on stack */
+    Peepfence;
+}
+
+prim P_until()			      /* Compile UNTIL */
+{
+    stackitem off;
+    atl_token *bp;
 
     Compiling;
     Sl(1);
-    Compconst(s_qbranch);	      /* Compile question branch */
+    Compword(s_qbranch);	      /* Compile question branch */
     Hpc(S0);
-    bp = (stackitem *) S0;	      /* Get BEGIN address */
-    off = -(hptr - bp);
+    bp = (atl_token *) S0;	      /* Get BEGIN address */
+    off = -(Chere - bp);
     Compconst(off);		      /* Compile negative jumpback address */
     Pop;
 }
@@ -2071,13 +4163,13 @@ prim P_until()			      /* Compile UNTIL */
 prim P_again()			      /* Compile AGAIN */
 {
     stackitem off;
-    stackitem *bp;
+    atl_token *bp;
 
     Compiling;
-    Compconst(s_branch);	      /* Compile unconditional branch */
+    Compword(s_branch); 	      /* Compile unconditional branch */
     Hpc(S0);
-    bp = (stackitem *) S0;	      /* Get BEGIN address */
-    off = -(hptr - bp);
+    bp = (atl_token *) S0;	      /* Get BEGIN address */
+    off = -(Chere - bp);
     Compconst(off);		      /* Compile negative jumpback address */
     Pop;
 }
@@ -2086,44 +4178,46 @@ prim P_while()			      /* Compile WHILE */
 {
     Compiling;
     So(1);
-    Compconst(s_qbranch);	      /* Compile question branch */
+    Compword(s_qbranch);	      /* Compile question branch */
     Compconst(0);		      /* Compile place-holder address cell */
-    Push = (stackitem) (hptr - 1);    /* Queue backpatch for REPEAT */
+    Push = (stackitem) (Chere - 1);   /* Queue backpatch for REPEAT */
 }
 
 prim P_repeat() 		      /* Compile REPEAT */
 {
     stackitem off;
-    stackitem *bp1, *bp;
+    atl_token *bp1, *bp;
 
     Compiling;
     Sl(2);
     Hpc(S0);
-    bp1 = (stackitem *) S0;	      /* Get WHILE backpatch address */
+    bp1 = (atl_token *) S0;	      /* Get WHILE backpatch address */
     Pop;
-    Compconst(s_branch);	      /* Compile unconditional branch */
+    Compword(s_branch); 	      /* Compile unconditional branch */
     Hpc(S0);
-    bp = (stackitem *) S0;	      /* Get BEGIN address */
-    off = -(hptr - bp);
+    bp = (atl_token *) S0;	      /* Get BEGIN address */
+    off = -(Chere - bp);
     Compconst(off);		      /* Compile negative jumpback address */
-    *bp1 = hptr - bp1;                /* Backpatch REPEAT's jump out of loop */
+    *bp1 = (atl_token) (Chere - bp1); /* Backpatch REPEAT's jump out of loop */
     Pop;
+    Peepfence;
 }
 
 prim P_do()			      /* Compile DO */
 {
     Compiling;
-    Compconst(s_xdo);		      /* Compile runtime DO word */
+    Compword(s_xdo);		      /* Compile runtime DO word */
     So(1);
     Compconst(0);		      /* Reserve cell for LEAVE-taking */
-    Push = (stackitem) hptr;	      /* Save jump back address on stack */
+    Push = (stackitem) Chere;	      /* Save jump back address on stack */
+    Peepfence;
 }
 
 prim P_xdo()			      /* Execute DO */
 {
     Sl(2);
     Rso(3);
-    Rpush = ip + ((stackitem) *ip);   /* Push exit address from loop */
+    Rpush = ip + Ipoff; 	      /* Push exit address from loop */
     ip++;			      /* Increment past exit address word */
     Rpush = (rstackitem) S1;	      /* Push loop limit on return stack */
     Rpush = (rstackitem) S0;	      /* Iteration variable initial value to
@@ -2134,20 +4228,21 @@ prim P_xdo()			      /* Execute DO */
 prim P_qdo()			      /* Compile ?DO */
 {
     Compiling;
-    Compconst(s_xqdo);		      /* Compile runtime ?DO word */
+    Compword(s_xqdo);		      /* Compile runtime ?DO word */
     So(1);
     Compconst(0);		      /* Reserve cell for LEAVE-taking */
-    Push = (stackitem) hptr;	      /* Save jump back address on stack */
+    Push = (stackitem) Chere;	      /* Save jump back address on stack */
+    Peepfence;
 }
 
 prim P_xqdo()			      /* Execute ?DO */
 {
     Sl(2);
     if (S0 == S1) {
-	ip += (stackitem) *ip;
+	ip += Ipoff;
     } else {
 	Rso(3);
-	Rpush = ip + ((stackitem) *ip);/* Push exit address from loop */
+	Rpush = ip + Ipoff;	      /* Push exit address from loop */
 	ip++;			      /* Increment past exit address word */
 	Rpush = (rstackitem) S1;      /* Push loop limit on return stack */
 	Rpush = (rstackitem) S0;      /* Iteration variable initial value to
@@ -2159,33 +4254,37 @@ prim P_xqdo()			      /* Execute ?DO */
 prim P_loop()			      /* Compile LOOP */
 {
     stackitem off;
-    stackitem *bp;
+    atl_token *bp;
 
     Compiling;
     Sl(1);
-    Compconst(s_xloop); 	      /* Compile runtime loop */
+    Compword(s_xloop); 	      /* Compile runtime loop */
     Hpc(S0);
-    bp = (stackitem *) S0;	      /* Get DO address */
-    off = -(hptr - bp);
+    bp = (atl_token *) S0;	      /* Get DO address */
+    off = -(Chere - bp);
     Compconst(off);		      /* Compile negative jumpback address */
-    *(bp - 1) = (hptr - bp) + 1;      /* Backpatch exit address offset */
+    *(bp - 1) = (atl_token) ((Chere - bp) + 1); /* Backpatch exit
+						   address offset */
     Pop;
+    Peepfence;
 }
 
 prim P_ploop()			      /* Compile +LOOP */
 {
     stackitem off;
-    stackitem *bp;
+    atl_token *bp;
 
     Compiling;
     Sl(1);
-    Compconst(s_pxloop);	      /* Compile runtime +loop */
+    Compword(s_pxloop);	      /* Compile runtime +loop */
     Hpc(S0);
-    bp = (stackitem *) S0;	      /* Get DO address */
-    off = -(hptr - bp);
+    bp = (atl_token *) S0;	      /* Get DO address */
+    off = -(Chere - bp);
     Compconst(off);		      /* Compile negative jumpback address */
-    *(bp - 1) = (hptr - bp) + 1;      /* Backpatch exit address offset */
+    *(bp - 1) = (atl_token) ((Chere - bp) + 1); /* Backpatch exit
+						   address offset */
     Pop;
+    Peepfence;
 }
 
 prim P_xloop()			      /* Execute LOOP */
@@ -2196,7 +4295,7 @@ prim P_xloop()			      /* Execute LOOP */
 	rstk -= 3;		      /* Pop iteration variable and limit */
 	ip++;			      /* Skip the jump address */
     } else {
-	ip += (stackitem) *ip;
+	ip += Ipoff;
     }
 }
 
@@ -2214,7 +4313,7 @@ prim P_xploop() 		      /* Execute +LOOP */
 	rstk -= 3;		      /* Pop iteration variable and limit */
 	ip++;			      /* Skip the jump address */
     } else {
-	ip += (stackitem) *ip;
+	ip += Ipoff;
 	R0 = (rstackitem) niter;
     }
 }
@@ -2243,7 +4342,7 @@ prim P_j()			      /* Obtain next-innermost loop index */
 prim P_quit()			      /* Terminate execution */
 {
     rstk = rstack;		      /* Clear return stack */
-#ifdef WALKBACK
+#ifdef WBSTACK
     wbptr = wback;
 #endif
     ip = NULL;			      /* Stop execution of current word */
@@ -2259,10 +4358,11 @@ prim P_abortq() 		      /* Abort, printing message */
 {
     if (state) {
 	stringlit = True;	      /* Set string literal expected */
-	Compconst(s_abortq);	      /* Compile ourselves */
+	Compword(s_abortq);	      /* Compile ourselves */
     } else {
-        V printf("%s", (char *) ip);  /* Otherwise, print string literal
-					 in in-line code. */
+	ip = Ipalign(ip);
+        V printf("%s", ((char *) ip) + 1); /* Otherwise, print string
+					 literal in in-line code. */
 #ifdef WALKBACK
 	pwalkback();
 #endif /* WALKBACK */
@@ -2277,6 +4377,10 @@ prim P_abortq() 		      /* Abort, printing message */
 
 prim P_immediate()		      /* Mark most recent word immediate */
 {
+#ifdef ROMDICT
+    if (dict == NULL)		      /* Primitives are read-only */
+	return;
+#endif
     dict->wname[0] |= IMMEDIATE;
 }
 
@@ -2296,14 +4400,14 @@ Exported void P_dodoes()	      /* Execute indirect call on method */
     Rso(1);
     So(1);
     Rpush = ip; 		      /* Push instruction pointer */
-#ifdef WALKBACK
+#ifdef WBSTACK
     *wbptr++ = curword; 	      /* Place word on walkback stack */
 #endif
     /* The compiler having craftily squirreled away the DOES> clause
        address before the word definition on the heap, we back up to
        the heap cell before the current word and load the pointer from
        there.  This is an ABSOLUTE heap address, not a relative offset. */
-    ip = *((dictword ***) (((stackitem *) curword) - 1));
+    ip = *((atl_token **) (((stackitem *) curword) - 1));
 
     /* Push the address of this word's body as the argument to the
        DOES> clause. */
@@ -2357,7 +4461,7 @@ prim P_does()			      /* Specify method for word */
 	   executing the DOES> clause at definition time. */
 
 	ip = R0;		      /* Set IP to top of return stack */
-#ifdef WALKBACK
+#ifdef WBSTACK
 	wbptr = (wbptr > wback) ? wbptr - 1 : wback;
 #endif
 	Rpop;			      /* Pop the return stack */
@@ -2373,13 +4477,16 @@ prim P_colon()			      /* Begin compilation */
 prim P_semicolon()		      /* End compilation */
 {
     Compiling;
-    Ho(1);
-    Hstore = s_exit;
+    Compword(s_exit);
     state = Falsity;		      /* No longer compiling */
     /* We wait until now to plug the P_nest code so that it will be
        present only in completed definitions. */
     if (createword != NULL)
+#ifdef VERIFY
+	createword->wcode = verify(createword) ? P_vnest : P_nest;
+#else
 	createword->wcode = P_nest;   /* Use P_nest for code */
+#endif
     createword = NULL;		      /* Flag no word being created */
 }
 
@@ -2440,6 +4547,117 @@ prim P_execute()		      /* Execute word pointed to by stack */
 					 the word. */
 }
 
+#ifdef CATCH
+
+/*  CATCHSAVE  --  Save the interpreter state in a frame, which the
+		   caller links in as the innermost once it has called
+		   setjmp().  */
+
+static void catchsave(cf)
+  atl_catch *cf;
+{
+    cf->cprev = catchp;
+    cf->cstk = stk;
+    cf->crstk = rstk;
+    cf->cip = ip;
+    cf->cword = curword;
+#ifdef WBSTACK
+    cf->cwbptr = wbptr;
+#endif
+#ifdef RSWALKBACK
+    cf->cwblevel = wblevel;
+#endif
+#ifdef TASKS
+    cf->cevaldepth = evaldepth;
+#endif
+    cf->cinstream = instream;
+    cf->ccomment = atl_comment;
+    cf->cstate = state;
+    cf->ccreate = createword;
+}
+
+/*  THROWCODE  --  Return to the innermost CATCH, restoring the state
+		   it saved, with a nonzero code on the stack.	*/
+
+static void throwcode(n)
+  stackitem n;
+{
+    atl_catch *cf = catchp;
+
+    catchp = cf->cprev;
+    stk = cf->cstk;
+    Push = n;			      /* CATCH popped its word, so room */
+    rstk = cf->crstk;
+    ip = cf->cip;
+    curword = cf->cword;
+#ifdef WBSTACK
+    wbptr = cf->cwbptr;
+#endif
+#ifdef RSWALKBACK
+    wblevel = cf->cwblevel;
+#endif
+#ifdef TASKS
+    evaldepth = cf->cevaldepth;
+#endif
+    Profexit(); 		      /* Close definitions thrown out of */
+    instream = cf->cinstream;
+    atl_comment = cf->ccomment;
+    state = cf->cstate;
+    createword = cf->ccreate;
+    forgetpend = defpend = stringlit =
+	tickpend = ctickpend = False;
+    evalstat = ATL_SNORM;
+    longjmp(cf->cjmp, 1);
+}
+
+prim P_catch()			      /* Run word:  word -- 0 | n */
+{
+    atl_catch cf;
+    dictword *wp;
+
+    Sl(1);
+    Rso(1);
+    wp = (dictword *) S0;
+    Pop;
+    catchsave(&cf);
+    if (setjmp(cf.cjmp) != 0)
+	return; 		      /* THROW has left its code */
+    catchp = &cf;
+    Rpush = ip; 		      /* Run the word to completion, as */
+    ip = NULL;			      /* atl_exec() does */
+#ifdef TASKS
+    evaldepth++;		      /* Its C frame is ours: no switching */
+#endif
+    exword(wp);
+#ifdef TASKS
+    evaldepth--;
+#endif
+    catchp = cf.cprev;
+    if (evalstat == ATL_SNORM) {      /* Not a break, which aborted */
+	ip = R0;
+	Rpop;
+	Push = 0;
+    }
+}
+
+prim P_throw()			      /* Raise exception:  n -- */
+{
+    stackitem n;
+    char msg[40];
+
+    Sl(1);
+    n = S0;
+    Pop;
+    if (n == 0)
+	return;
+    if (catchp != NULL)
+	throwcode(n);
+    V sprintf(msg, "Uncaught THROW %ld", (long) n);
+    evalstat = ATL_THROW;
+    trouble(msg);
+}
+#endif /* CATCH */
+
 prim P_body()			      /* Get body address for word */
 {
     Sl(1);
@@ -2485,9 +4703,14 @@ prim P_toname() 		      /* Find name field from compile addr */
 
 prim P_tolink() 		      /* Find link field from compile addr */
 {
+#ifdef ROMDICT
+    Sl(1);
+    S0 += DfOff(wnext);	      /* Wnext follows name and code */
+#else
 if (DfOff(wnext) != 0) V printf("\n>LINK Foulup--wnext is not at zero!\n");
 /*  Sl(1);
     S0 += DfOff(wnext);  */	      /* Null operation.  Wnext is first */
+#endif
 }
 
 prim P_frombody()		      /* Get compile address from body */
@@ -2504,9 +4727,14 @@ prim P_fromname()		      /* Get compile address from name */
 
 prim P_fromlink()		      /* Get compile address from link */
 {
+#ifdef ROMDICT
+    Sl(1);
+    S0 -= DfOff(wnext);	      /* Wnext follows name and code */
+#else
 if (DfOff(wnext) != 0) V printf("\nLINK> Foulup--wnext is not at zero!\n");
 /*  Sl(1);
     S0 -= DfOff(wnext);  */	      /* Null operation.  Wnext is first */
+#endif
 }
 
 #undef DfOff
@@ -2563,10 +4791,27 @@ prim P_storename()		      /* Store string buffer in word name */
     Hpc(S0);			      /* See comments in P_fetchname above */
     Hpc(S1);			      /* checking name pointers */
     tflags = **((char **) S0);
+#ifdef NAMEARENA
+    /* The name is renamed in place, since a name allocated anew in
+       the arena would be out of order with the words defined after
+       this one.  The new name must fit in the old one's cells. */
+    cp = *((char **) S0);
+    if ((strlen((char *) S1) + 2 + (sizeof(stackitem) - 1)) /
+	    sizeof(stackitem) >
+	(strlen(cp + 1) + 2 + (sizeof(stackitem) - 1)) / sizeof(stackitem)) {
+	evalstat = ATL_HEAPOVER;
+	trouble("Name too long");
+	return;
+    }
+#else
     free(*((char **) S0));
     *((char **) S0) = cp = alloc((unsigned int) (strlen((char *) S1) + 2));
+#endif
     V strcpy(cp + 1, (char *) S1);
     *cp = tflags;
+#ifdef HASHDICT
+    dhrebuild(dhlen);		      /* Word moved to another bucket */
+#endif
     Pop2;
 }
 
@@ -2624,7 +4869,7 @@ prim P_wordsunused()		      /* List words not used by program */
     dictword *dw = dict;
 
     while (dw != NULL) {
-	if (!(*(dw->wname) & WORDUSED)) {
+	if (!(*(dw->wname) & (WORDUSED | WORDHIDDEN))) {
            V printf("\n%s", dw->wname + 1);
 	}
 #ifdef Keyhit
@@ -2638,6 +4883,191 @@ prim P_wordsunused()		      /* List words not used by program */
 }
 #endif /* WORDSUSED */
 
+#ifdef PROFILE
+
+/*  The profile counts the times each word is executed and accumulates
+    the time spent in it.  A word's own time runs from its dispatch to
+    the next one, so a definition is charged with entering it and
+    dispatching its words, and those words with the rest.  The time of
+    a definition including the words it calls runs from entry to exit,
+    and is counted once for a recursive definition.  Only definitions
+    entered on the current return stack are timed inclusively; one
+    left by an error is closed at the next exit below it.  */
+
+/*  PROFENT  --  Find or make the profile entry for a word.  Returns
+		 NULL if the table is full.  */
+
+static atl_profent *profent(w)
+  dictword *w;
+{
+    unsigned int h = (unsigned int) (((unsigned long) w) >> 2), n;
+
+    h ^= h >> 7;
+    for (n = 0; n < Proflen; n++) {
+	atl_profent *pe = &profp->ptab[(h + n) & (Proflen - 1)];
+
+	if (pe->pword == w)
+	    return pe;
+	if (pe->pword == NULL) {
+	    pe->pword = w;
+	    return pe;
+	}
+    }
+    return NULL;
+}
+
+/*  PROFWORD  --  Charge the time since the last dispatch to the word
+		  then running and start timing curword.  */
+
+static void profword()
+{
+    unsigned long t = Profclock();
+    atl_profent *pe = profp->pcur;
+
+    if (pe != NULL)
+	pe->pself += t - profp->ptime;
+    profp->ptime = t;
+    profp->pwords++;
+    if ((pe = profent(curword)) != NULL)
+	pe->pcalls++;
+    profp->pcur = pe;
+}
+
+/*  PROFNEST  --  Start the inclusive timing of the definition in
+		  curword, whose return address is on top of the
+		  return stack.  */
+
+static void profnest()
+{
+    atl_profent *pe;
+
+    if (profp->pnframe < Profdepth && (pe = profent(curword)) != NULL) {
+	profp->pframe[profp->pnframe].fent = pe;
+	profp->pframe[profp->pnframe].frp = rstk;
+	profp->pframe[profp->pnframe].ft0 = Profclock();
+	profp->pnframe++;
+	pe->pactive++;
+    }
+}
+
+/*  PROFCLOSE  --  End the inclusive timing of definitions whose return
+		   addresses were above a return stack position.  */
+
+static void profclose(rp)
+  rstackitem *rp;
+{
+    unsigned long t = Profclock();
+
+    while (profp->pnframe > 0 && profp->pframe[profp->pnframe - 1].frp > rp) {
+	profp->pnframe--;
+	if (--profp->pframe[profp->pnframe].fent->pactive == 0)
+	    profp->pframe[profp->pnframe].fent->pincl +=
+		t - profp->pframe[profp->pnframe].ft0;
+    }
+}
+
+/*  PROFDONE  --  Charge the last word run by exword() on its return. */
+
+static void profdone()
+{
+    if (profp->pcur != NULL) {
+	profp->pcur->pself += Profclock() - profp->ptime;
+	profp->pcur = NULL;
+    }
+}
+
+/*  PROFKNOWN  --  Test whether a profiled word is still defined.  */
+
+static Boolean profknown(w)
+  dictword *w;
+{
+    dictword *dw;
+
+#ifdef ROMDICT
+    for (dw = dictnext(NULL); dw != NULL; dw = dictnext(dw)) {
+#else
+    for (dw = dict; dw != NULL; dw = dw->wnext) {
+#endif
+	if (dw == w)
+	    return True;
+    }
+    return False;
+}
+
+prim P_profile()		      /* Start or stop profiling */
+{				      /* flag -- */
+    Sl(1);
+    if (S0 != 0) {
+	if (profp == NULL)
+	    profp = (atl_prof *) alloc(sizeof(atl_prof));
+	V memset((char *) profp, 0, sizeof(atl_prof));
+	profon = True;
+    } else if (profon) {
+	profclose(rstack - 1);	      /* Close all definitions timed */
+	profp->pcur = NULL;
+	profon = False;
+    }
+    Pop;
+}
+
+prim P_dotprofile()		      /* Print the words taking most time */
+{				      /* n -- */
+    atl_profent *last = NULL;
+    unsigned long long total = 0;
+    int i, n;
+
+    Sl(1);
+    n = (int) S0;
+    Pop;
+    if (profp == NULL)
+	return;
+    for (i = 0; i < Proflen; i++)
+	total += profp->ptab[i].pself;
+    V printf("\nWord                    Calls         Self    Inclusive  Self%%\n");
+
+    /* Select the entries in decreasing order of their own time, those
+       with equal times in table order. */
+
+    while (n-- > 0) {
+	atl_profent *pe, *best = NULL;
+
+	for (pe = profp->ptab; pe < profp->ptab + Proflen; pe++) {
+	    if (pe->pword == NULL || pe->pcalls == 0)
+		continue;
+	    if (last != NULL && (pe->pself > last->pself ||
+		(pe->pself == last->pself && pe <= last)))
+		continue;
+	    if (best == NULL || pe->pself > best->pself)
+		best = pe;
+	}
+	if (best == NULL)
+	    break;
+	last = best;
+	if (!profknown(best->pword)) {
+	    n++;		      /* Forgotten since it was profiled */
+	    continue;
+	}
+	V printf("%-20s %8lu %12llu %12llu %5.1f\n", best->pword->wname + 1,
+	    best->pcalls, best->pself,
+	    (best->pincl != 0) ? best->pincl : best->pself,
+	    (total == 0) ? 0.0 : (100.0 * best->pself) / total);
+#ifdef Keyhit
+	if (kbquit()) {
+	    break;
+	}
+#endif
+    }
+}
+
+/*  ATL_PROFWORDS  --  Return the number of words executed since
+		       profiling was last started.  */
+
+unsigned long atl_profwords()
+{
+    return (profp == NULL) ? 0 : profp->pwords;
+}
+#endif /* PROFILE */
+
 #ifdef COMPILERW
 
 prim P_brackcompile()		      /* Force compilation of immediate word */
@@ -2650,25 +5080,24 @@ prim P_literal()		      /* Compile top of stack as literal */
 {
     Compiling;
     Sl(1);
-    Ho(2);
-    Hstore = s_lit;		      /* Compile load literal word */
-    Hstore = S0;		      /* Compile top of stack in line */
+    Complit(S0);		      /* Compile top of stack in line */
     Pop;
 }
 
 prim P_compile()		      /* Compile address of next inline word */
 {
     Compiling;
-    Ho(1);
-    Hstore = (stackitem) *ip++;       /* Compile the next datum from the
+    Compconst(*ip);		      /* Compile the next datum from the
 					 instruction stream. */
+    ip++;
 }
 
 prim P_backmark()		      /* Mark backward backpatch address */
 {
     Compiling;
     So(1);
-    Push = (stackitem) hptr;	      /* Push heap address onto stack */
+    Push = (stackitem) Chere;	      /* Push heap address onto stack */
+    Peepfence;
 }
 
 prim P_backresolve()		      /* Emit backward jump offset */
@@ -2677,19 +5106,18 @@ prim P_backresolve()		      /* Emit backward jump offset */
 
     Compiling;
     Sl(1);
-    Ho(1);
     Hpc(S0);
-    offset = -(hptr - (stackitem *) S0);
-    Hstore = offset;
+    offset = -(Chere - (atl_token *) S0);
+    Compconst(offset);
     Pop;
 }
 
 prim P_fwdmark()		      /* Mark forward backpatch address */
 {
     Compiling;
-    Ho(1);
-    Push = (stackitem) hptr;	      /* Push heap address onto stack */
-    Hstore = 0;
+    So(1);
+    Push = (stackitem) Chere;	      /* Push heap address onto stack */
+    Compconst(0);
 }
 
 prim P_fwdresolve()		      /* Emit forward jump offset */
@@ -2699,69 +5127,360 @@ prim P_fwdresolve()		      /* Emit forward jump offset */
     Compiling;
     Sl(1);
     Hpc(S0);
-    offset = (hptr - (stackitem *) S0);
-    *((stackitem *) S0) = offset;
+    offset = (Chere - (atl_token *) S0);
+    *((atl_token *) S0) = (atl_token) offset;
     Pop;
+    Peepfence;
 }
 
 #endif /* COMPILERW */
 
-/*  Table of primitive words  */
+/*  Words compiled with an in-line branch offset  */
 
-static struct primfcn primt[] = {
-    {"0+", P_plus},
-    {"0-", P_minus},
-    {"0*", P_times},
-    {"0/", P_div},
-    {"0MOD", P_mod},
-    {"0/MOD", P_divmod},
-    {"0MIN", P_min},
-    {"0MAX", P_max},
-    {"0NEGATE", P_neg},
-    {"0ABS", P_abs},
-    {"0=", P_equal},
-    {"0<>", P_unequal},
-    {"0>", P_gtr},
-    {"0<", P_lss},
-    {"0>=", P_geq},
-    {"0<=", P_leq},
+#ifdef PEEPHOLE
+#define Vbranch(c)  ((c) == P_branch || (c) == P_qbranch || \
+		     (c) == P_xdo || (c) == P_xqdo || \
+		     (c) == P_xloop || (c) == P_xploop || \
+		     (c) == P_dupqbranch || (c) == P_zqbranch)
+#else
+#define Vbranch(c)  ((c) == P_branch || (c) == P_qbranch || \
+		     (c) == P_xdo || (c) == P_xqdo || \
+		     (c) == P_xloop || (c) == P_xploop)
+#endif
 
-    {"0AND", P_and},
-    {"0OR", P_or},
-    {"0XOR", P_xor},
-    {"0NOT", P_not},
-    {"0SHIFT", P_shift},
+/*  TOKSKIP  --  Return the address following the in-line operands, if
+		any, of a word with code c compiled just before p.  */
 
-    {"0DEPTH", P_depth},
-    {"0CLEAR", P_clear},
-    {"0DUP", P_dup},
-    {"0DROP", P_drop},
-    {"0SWAP", P_swap},
-    {"0OVER", P_over},
-    {"0PICK", P_pick},
-    {"0ROT", P_rot},
-    {"0-ROT", P_minusrot},
-    {"0ROLL", P_roll},
-    {"0>R", P_tor},
-    {"0R>", P_rfrom},
-    {"0R@", P_rfetch},
+static atl_token *tokskip(p, c)
+  atl_token *p;
+  codeptr c;
+{
+    if (c == P_dolit)
+	return Ipalign(p) + Tokcell;
+#ifdef TOKTHREAD
+    if (c == P_doslit)
+	return p + 1;
+#endif
+#ifdef PEEPHOLE
+    if (c == P_litat || c == P_litbang)
+	return Ipalign(p) + Tokcell;
+    if (c == P_litplus)
+	return p + 1;
+#endif
+#ifdef TAILCALL
+    if (c == P_tail)
+	return p + 1;
+#endif
+#ifdef REAL
+    if (c == P_flit)
+	return Ipalign(p) + Realsize * Tokcell;
+#endif
+#ifdef STRING
+    if (c == P_strlit) {
+	p = Ipalign(p);
+	return p + *((char *) p);
+    }
+#endif
+#ifdef CONIO
+    if (c == P_dotparen) {
+	p = Ipalign(p);
+	return p + *((char *) p);
+    }
+#endif
+    if (Vbranch(c))
+	return p + 1;
+    return p;
+}
+
+#ifdef PEEPHOLE
+
+/*  Peephole optimiser.  Compword() passes each word it compiles to
+    compword(), which remembers the last few words it compiled and
+    where they went.  When the new word completes one of these
+    sequences, the code is rewritten in place instead:
+
+	lit lit op	   --> lit	  op: + - * AND OR XOR MIN MAX
+	lit op		   --> lit	  op: NEGATE ABS NOT 1+ 2+ ...
+	(LIT) n +	   --> (LIT+) n   (SLIT with TOKTHREAD); also -
+	(LIT+) m (LIT) n + --> (LIT+) m+n
+	(LIT) a @	   --> (LIT@) a
+	(LIT) a !	   --> (LIT!) a
+	var @, var !	   --> (LIT@), (LIT!) of the body (not TOKTHREAD)
+	def EXIT	   --> (TAIL) def (TAILCALL)
+	DUP ?BRANCH	   --> (DUP?BRANCH)
+	0= ?BRANCH	   --> (0=?BRANCH)
+	I +		   --> (I+)
+	OVER OVER	   --> 2DUP
+
+    Literals are folded by running the primitive on the stack, so the
+    result is exactly what the code would have computed.  The record is
+    forgotten when anything but Compword() extends the code, and at a
+    Peepfence.  */
+
+#ifdef TOKTHREAD
+#define Peepslit(c) ((c) == P_doslit)
+#else
+#define Peepslit(c) False
+#endif
+#define Peeplit(c)  ((c) == P_dolit || Peepslit(c))
+#ifdef VERIFY
+#define Peepdef(c)  ((c) == P_nest || (c) == P_vnest)
+#else
+#define Peepdef(c)  ((c) == P_nest)
+#endif
 
-#ifdef SHORTCUTA
-    {"01+", P_1plus},
-    {"02+", P_2plus},
-    {"01-", P_1minus},
-    {"02-", P_2minus},
-    {"02*", P_2times},
-    {"02/", P_2div},
-#endif /* SHORTCUTA */
+static const codeptr peepfold2[] = {  /* Binary operators folded */
+    P_plus, P_minus, P_times, P_and, P_or, P_xor, P_min, P_max, NULL
+};
 
+static const codeptr peepfold1[] = {  /* Unary operators folded */
+    P_neg, P_abs, P_not,
+#ifdef SHORTCUTA
+    P_1plus, P_2plus, P_1minus, P_2minus, P_2times, P_2div,
+#endif
 #ifdef SHORTCUTC
-    {"00=", P_0equal},
-    {"00<>", P_0notequal},
-    {"00>", P_0gtr},
-    {"00<", P_0lss},
-#endif /* SHORTCUTC */
-
+    P_0equal, P_0notequal, P_0gtr, P_0lss,
+#endif
+    NULL
+};
+
+/*  PEEPIN  --  Test whether a code is in a list.  */
+
+static Boolean peepin(c, cl)
+  codeptr c;
+  const codeptr *cl;
+{
+    while (*cl != NULL) {
+	if (*cl++ == c)
+	    return True;
+    }
+    return False;
+}
+
+/*  PEEPVAL  --  Return the value of the literal compiled at p.  */
+
+static stackitem peepval(p)
+  atl_token *p;
+{
+    if (Peepslit(Tokword(*p)->wcode))
+	return Tokoff(p + 1);
+    return *((stackitem *) Ipalign(p + 1));
+}
+
+/*  PEEPBACK  --  Discard the code from p on, which was compiled as the
+		  n-th word of the record, and the record from there.  */
+
+static void peepback(p, n)
+  atl_token *p;
+  int n;
+{
+#ifdef TOKTHREAD
+    if (p == Ipalign(p)) {
+	hptr = (stackitem *) p;
+	tokhptr = NULL;
+    } else {
+	atl_token *tp;
+
+	hptr = (stackitem *) Ipalign(p);
+	tokhptr = hptr;
+	tokfree = p;
+	for (tp = p; tp < (atl_token *) hptr; tp++)
+	    *tp = 0;
+    }
+#else
+    hptr = (stackitem *) p;
+#endif
+    npeep = n;
+}
+
+#undef Memerrs
+#define Memerrs False
+
+/*  COMPWORD  --  Compile a reference to a word, or rewrite the code
+		  compiled before it to include it.  */
+
+static Boolean compword(dw)
+  dictword *dw;
+{
+    codeptr c = dw->wcode, c1 = NULL, c2 = NULL;
+    dictword *fw = NULL;
+    atl_token *p1 = NULL;
+    int n = npeep;
+
+    if (n > 0 && tokskip(peepat[n - 1] + 1, peepw[n - 1]->wcode) != Chere)
+	n = 0;			      /* Code was added behind our back */
+    if (n > 0) {
+	p1 = peepat[n - 1];
+	c1 = peepw[n - 1]->wcode;
+    }
+    if (n > 1)
+	c2 = peepw[n - 2]->wcode;
+
+    if (Peeplit(c1) && (stk + 2) <= stacktop &&
+	((Peeplit(c2) && peepin(c, peepfold2)) || peepin(c, peepfold1))) {
+	Boolean two = Peeplit(c2) && peepin(c, peepfold2);
+	stackitem v;
+
+	if (two) {
+	    p1 = peepat[n - 2];
+	    *stk++ = peepval(p1);
+	}
+	*stk++ = peepval(peepat[n - 1]);
+	(*c)(); 		      /* Compute the value at compile time */
+	v = S0;
+	Pop;
+	peepback(p1, n - (two ? 2 : 1));
+	return complit(v);
+    }
+
+    if (Peeplit(c1) && (c == P_plus || c == P_minus)) {
+	stackitem v = peepval(p1);
+
+	if (c == P_minus)
+	    v = (stackitem) (- (unsigned long) v);
+	if (c2 == P_litplus) {	      /* Add to the (LIT+) before it */
+	    atl_token *p2 = peepat[n - 2];
+	    stackitem v2 = (stackitem) (((unsigned long) Tokoff(p2 + 1)) +
+					 ((unsigned long) v));
+#ifdef TOKTHREAD
+	    if (v2 == (short) v2)
+#endif
+	    {
+		*(p2 + 1) = (atl_token) v2;
+		peepback(p1, n - 1);
+		return True;
+	    }
+	}
+#ifdef TOKTHREAD
+	if (c1 == P_doslit && v == (short) v)
+#endif
+	{
+	    *(p1 + 1) = (atl_token) v;
+	    fw = (dictword *) s_litplus;
+	}
+    } else if (c1 == P_dolit && (c == P_at || c == P_bang)) {
+	fw = (dictword *) ((c == P_at) ? s_litat : s_litbang);
+#ifndef TOKTHREAD
+    } else if (c1 == P_var && (c == P_at || c == P_bang) &&
+	       peepw[n - 1] != createword) {
+	stackitem *body = ((stackitem *) peepw[n - 1]) + Dictwordl;
+
+	Ho(1);
+	Hstore = (stackitem) body;    /* Variable's body is the operand */
+	fw = (dictword *) ((c == P_at) ? s_litat : s_litbang);
+#endif
+    } else if (c1 == P_dup && c == P_qbranch) {
+	fw = (dictword *) s_dupqbranch;
+#ifdef SHORTCUTC
+    } else if (c1 == P_0equal && c == P_qbranch) {
+	fw = (dictword *) s_zqbranch;
+#endif
+    } else if (c1 == P_i && c == P_plus) {
+	fw = (dictword *) s_iplus;
+#ifdef DOUBLE
+    } else if (c1 == P_over && c == P_over) {
+	fw = (dictword *) s_2dup;
+#endif
+#ifdef TAILCALL
+    } else if (c == P_exit &&
+	       (Peepdef(c1) || (n > 0 && peepw[n - 1] == createword))) {
+#ifdef TOKTHREAD
+	if (!ctword(peepw[n - 1]))    /* The word becomes the operand */
+	    return False;
+#else
+	Ho(1);
+	Hstore = (stackitem) peepw[n - 1]; /* The word becomes the operand */
+#endif
+	fw = (dictword *) s_tail;
+#endif
+    }
+
+    if (fw != NULL) {		      /* Rewrite the last word */
+	*p1 = Wordtok(fw);
+	peepw[n - 1] = fw;
+	npeep = n;
+	return True;
+    }
+
+    if (n == ELEMENTS(peepw)) {       /* Forget the oldest word */
+	for (n = 1; n < ELEMENTS(peepw); n++) {
+	    peepw[n - 1] = peepw[n];
+	    peepat[n - 1] = peepat[n];
+	}
+	n--;
+    }
+    peepw[n] = dw;
+    peepat[n] = Chere;
+    npeep = n + 1;
+#ifdef TOKTHREAD
+    return ctword(dw);
+#else
+    Ho(1);
+    Hstore = (stackitem) dw;
+    return True;
+#endif
+}
+
+#undef Memerrs
+#define Memerrs
+#endif /* PEEPHOLE */
+
+/*  Table of primitive words  */
+
+static const struct primfcn primt[] = {
+    {"0+", P_plus},
+    {"0-", P_minus},
+    {"0*", P_times},
+    {"0/", P_div},
+    {"0MOD", P_mod},
+    {"0/MOD", P_divmod},
+    {"0MIN", P_min},
+    {"0MAX", P_max},
+    {"0NEGATE", P_neg},
+    {"0ABS", P_abs},
+    {"0=", P_equal},
+    {"0<>", P_unequal},
+    {"0>", P_gtr},
+    {"0<", P_lss},
+    {"0>=", P_geq},
+    {"0<=", P_leq},
+
+    {"0AND", P_and},
+    {"0OR", P_or},
+    {"0XOR", P_xor},
+    {"0NOT", P_not},
+    {"0SHIFT", P_shift},
+
+    {"0DEPTH", P_depth},
+    {"0CLEAR", P_clear},
+    {"0DUP", P_dup},
+    {"0DROP", P_drop},
+    {"0SWAP", P_swap},
+    {"0OVER", P_over},
+    {"0PICK", P_pick},
+    {"0ROT", P_rot},
+    {"0-ROT", P_minusrot},
+    {"0ROLL", P_roll},
+    {"0>R", P_tor},
+    {"0R>", P_rfrom},
+    {"0R@", P_rfetch},
+
+#ifdef SHORTCUTA
+    {"01+", P_1plus},
+    {"02+", P_2plus},
+    {"01-", P_1minus},
+    {"02-", P_2minus},
+    {"02*", P_2times},
+    {"02/", P_2div},
+#endif /* SHORTCUTA */
+
+#ifdef SHORTCUTC
+    {"00=", P_0equal},
+    {"00<>", P_0notequal},
+    {"00>", P_0gtr},
+    {"00<", P_0lss},
+#endif /* SHORTCUTC */
+
 #ifdef DOUBLE
     {"02DUP", P_2dup},
     {"02DROP", P_2drop},
@@ -2786,6 +5505,11 @@ static struct primfcn primt[] = {
     {"0C,", P_ccomma},
     {"0C=", P_cequal},
     {"0HERE", P_here},
+#ifdef MEMPOOL
+    {"0ALLOCATE", P_allocate},
+    {"0FREE", P_free},
+    {"0RESIZE", P_resize},
+#endif
 
 #ifdef ARRAY
     {"0ARRAY", P_array},
@@ -2809,6 +5533,18 @@ static struct primfcn primt[] = {
 #endif
     {"0STRINT", P_strint},
     {"0STRREAL", P_strreal},
+    {"0CSTRING", P_cstring},
+    {"0CS@", P_csat},
+    {"0CSLEN", P_cslen},
+    {"0CS>STR", P_cstostr},
+    {"0CS!", P_csbang},
+    {"0CS+", P_csplus},
+    {"0CSC+", P_cscplus},
+    {"0CSFORM", P_csform},
+    {"0STR>S", P_strtoslice},
+    {"0SLICE", P_slice},
+    {"0STYPE", P_stype},
+    {"0SCOMPARE", P_scompare},
 #endif /* STRING */
 
 #ifdef REAL
@@ -2848,8 +5584,22 @@ static struct primfcn primt[] = {
     {"0(NEST)", P_nest},
     {"0EXIT", P_exit},
     {"0(LIT)", P_dolit},
+#ifdef TOKTHREAD
+    {"0(SLIT)", P_doslit},
+#endif
     {"0BRANCH", P_branch},
     {"0?BRANCH", P_qbranch},
+#ifdef PEEPHOLE
+    {"0(LIT+)", P_litplus},
+    {"0(LIT@)", P_litat},
+    {"0(LIT!)", P_litbang},
+    {"0(DUP?BRANCH)", P_dupqbranch},
+    {"0(0=?BRANCH)", P_zqbranch},
+    {"0(I+)", P_iplus},
+#endif
+#ifdef TAILCALL
+    {"0(TAIL)", P_tail},
+#endif
     {"1IF", P_if},
     {"1ELSE", P_else},
     {"1THEN", P_then},
@@ -2888,6 +5638,10 @@ static struct primfcn primt[] = {
     {"0WORDSUSED", P_wordsused},
     {"0WORDSUNUSED", P_wordsunused},
 #endif
+#ifdef PROFILE
+    {"0PROFILE", P_profile},
+    {"0.PROFILE", P_dotprofile},
+#endif
 
 #ifdef MEMSTAT
     {"0MEMSTAT", atl_memstat},
@@ -2900,6 +5654,7 @@ static struct primfcn primt[] = {
     {"0]", P_rbrack},
     {"0CREATE", P_create},
     {"0FORGET", P_forget},
+    {"0MARKER", P_marker},
     {"0DOES>", P_does},
     {"0'", P_tick},
     {"1[']", P_bracktick},
@@ -2955,12 +5710,77 @@ static struct primfcn primt[] = {
     {"0FTELL", P_ftell},
     {"0FSEEK", P_fseek},
     {"0FLOAD", P_fload},
+    {"0INCLUDE", P_include},
 #endif /* FILEIO */
 
 #ifdef EVALUATE
     {"0EVALUATE", P_evaluate},
 #endif /* EVALUATE */
 
+#ifdef CATCH
+    {"0CATCH", P_catch},
+    {"0THROW", P_throw},
+#endif /* CATCH */
+
+#ifdef TASKS
+    {"0PAUSE", P_pause},
+    {"0TASK", P_task},
+    {"0STOP", P_stop},
+#endif /* TASKS */
+
+#ifdef VERIFY
+    /* Hidden second entries for the primitives exword() expands
+       inline select the copies without stack checks, which verify()
+       substitutes in definitions that can't overflow or underflow. */
+    {"4EXIT", P_exit},
+    {"4(LIT)", P_dolit},
+#ifdef TOKTHREAD
+    {"4(SLIT)", P_doslit},
+#endif
+    {"4?BRANCH", P_qbranch},
+    {"4(XDO)", P_xdo},
+    {"4(X?DO)", P_xqdo},
+    {"4(XLOOP)", P_xloop},
+    {"4(+XLOOP)", P_xploop},
+    {"4I", P_i},
+    {"4J", P_j},
+    {"4+", P_plus},
+    {"4-", P_minus},
+    {"4*", P_times},
+    {"4DUP", P_dup},
+    {"4DROP", P_drop},
+    {"4SWAP", P_swap},
+    {"4OVER", P_over},
+    {"4ROT", P_rot},
+    {"4>R", P_tor},
+    {"4R>", P_rfrom},
+    {"4@", P_at},
+    {"4!", P_bang},
+    {"4=", P_equal},
+    {"4<", P_lss},
+    {"4>", P_gtr},
+    {"4AND", P_and},
+    {"4OR", P_or},
+#ifdef SHORTCUTA
+    {"41+", P_1plus},
+    {"41-", P_1minus},
+#endif
+#ifdef SHORTCUTC
+    {"40=", P_0equal},
+#endif
+#ifdef PEEPHOLE
+    {"4(LIT+)", P_litplus},
+    {"4(LIT@)", P_litat},
+    {"4(LIT!)", P_litbang},
+    {"4(DUP?BRANCH)", P_dupqbranch},
+    {"4(0=?BRANCH)", P_zqbranch},
+    {"4(I+)", P_iplus},
+#ifdef DOUBLE
+    {"42DUP", P_2dup},
+#endif
+#endif
+#endif /* VERIFY */
+
     {NULL, (codeptr) 0}
 };
 
@@ -2970,9 +5790,9 @@ static struct primfcn primt[] = {
 		     the items and link them internally within the buffer. */
 
 Exported void atl_primdef(pt)
-  struct primfcn *pt;
+  const struct primfcn *pt;
 {
-    struct primfcn *pf = pt;
+    const struct primfcn *pf = pt;
     dictword *nw;
     int i, n = 0;
 #ifdef WORDSUSED
@@ -2989,13 +5809,59 @@ Exported void atl_primdef(pt)
 	pf++;
     }
 
+#ifdef ROMDICT
+
+    /* Use the table in place as a ROM segment, which requires only
+       its name index in memory.  The index is built in two passes,
+       counting the items in each hash bucket, then placing them.
+       Placing the items in reverse order leaves each bucket in table
+       order, so lookup() finds the first of duplicate names just as
+       it would in the dictionary chain.  If all the segments are in
+       use, fall through and copy the table into the heap as usual. */
+
+    for (i = 0; i < nromseg; i++) {
+	if (romseg[i].rbase == (const dictword *) pt) {
+#ifdef TOKTHREAD
+	    tokseg((dictword *) pt, n); /* Each instance numbers its own */
+#endif
+	    return;		      /* Already defined by another instance */
+	}
+    }
+    if (nromseg < Romsegs) {
+	struct romseg *rs = &romseg[nromseg];
+	unsigned int nb = 1, b;
+
+	while ((2 * nb) < n)
+	    nb *= 2;
+	rs->rbase = (const dictword *) pt;
+	rs->rlen = n;
+	rs->rmask = nb - 1;
+	rs->rbucket = (unsigned short *)
+	    alloc((nb + 1 + n) * sizeof(unsigned short));
+	rs->rindex = rs->rbucket + nb + 1;
+	for (b = 0; b <= nb; b++)
+	    rs->rbucket[b] = 0;
+	for (i = 0; i < n; i++)
+	    rs->rbucket[dhashf(pt[i].pname + 1) & rs->rmask]++;
+	for (b = 1; b <= nb; b++)     /* Bucket counts to bucket ends */
+	    rs->rbucket[b] += rs->rbucket[b - 1];
+	for (i = n - 1; i >= 0; i--)
+	    rs->rindex[--rs->rbucket[dhashf(pt[i].pname + 1) & rs->rmask]] = i;
+	nromseg++;
+#ifdef TOKTHREAD
+	tokseg((dictword *) pt, n);
+#endif
+	return;
+    }
+#endif /* ROMDICT */
+
 #ifdef WORDSUSED
 #ifdef READONLYSTRINGS
     nltotal = n;
     for (i = 0; i < n; i++) {
 	nltotal += strlen(pt[i].pname);
     }
-    cp = dynames = alloc(nltotal);
+    cp = dynames = primalloc(nltotal);
     for (i = 0; i < n; i++) {
 	strcpy(cp, pt[i].pname);
 	cp += strlen(cp) + 1;
@@ -3004,7 +5870,10 @@ Exported void atl_primdef(pt)
 #endif /* READONLYSTRINGS */
 #endif /* WORDSUSED */
 
-    nw = (dictword *) alloc((unsigned int) (n * sizeof(dictword)));
+    nw = (dictword *) primalloc((unsigned int) (n * sizeof(dictword)));
+#ifdef TOKTHREAD
+    tokseg(nw, n);
+#endif
 
     nw[n - 1].wnext = dict;
     dict = nw;
@@ -3025,9 +5894,31 @@ Exported void atl_primdef(pt)
 	nw++;
 	pt++;
     }
+
+    /* A table defined after atl_init() is protected like the built-in
+       words.  FORGET, atl_unwind() and snapshots cut the dictionary
+       back no further than dictprot, taking any word not in the heap
+       to lie below it, so would otherwise drop the whole table. */
+
+    if (dictprot != NULL) {
+	dictprot = dict;
+#ifdef SNAPSHOT
+	heapprot = hptr;
+#endif
+    }
+#ifdef HASHDICT
+    {
+	unsigned int len = (dhlen == 0) ? Dhashlen : dhlen;
+
+	while (dhcount + n >= 2 * len)
+	    len *= 2;
+	dhrebuild(len); 	      /* Index the new block of words */
+    }
+#endif
 }
 
 #ifdef WALKBACK
+#ifdef WBSTACK
 
 /*  PWALKBACK  --  Print walkback trace.  */
 
@@ -3044,6 +5935,131 @@ static void pwalkback()
 	}
     }
 }
+#else /* RSWALKBACK */
+
+/*  Without a walkback stack, the words being run are found from the
+    return stack.  The code running in each frame is that of the word
+    containing the address the frame has reached: ip for the innermost,
+    and for each one outside it the return address the next one in
+    pushed.  The word named at the call before a return address is the
+    one that was called, which may instead be a word made by DOES>
+    whose clause is that code.	A tail call leaves the caller's call
+    naming the word it replaced, so then the word containing the code
+    stands.  exword() leaves a note of the words it was called to
+    run, which the interpreter, EXECUTE and atl_exec() don't compile
+    a call of, EVALUATE one of where its caller had reached, and the
+    task code names the word each task began with.
+    Other items on the return stack, loop exit addresses and those
+    placed there by >R, are passed over.  */
+
+#ifdef VERIFY
+#define Isdef(dw)   ((dw)->wcode == P_nest || (dw)->wcode == P_vnest)
+#else
+#define Isdef(dw)   ((dw)->wcode == P_nest)
+#endif
+
+/*  WBCODE  --  Return the definition in whose code an address lies,
+		or NULL if it isn't within one on the heap.  Words on
+		the heap lie in the order they were defined.  */
+
+static dictword *wbcode(p)
+  atl_token *p;
+{
+    stackitem *end = hptr;
+    dictword *dw;
+
+    if (((stackitem *) p) <= heap || ((stackitem *) p) >= hptr)
+	return NULL;
+    for (dw = dict; dw != NULL; dw = dw->wnext) {
+	if (((stackitem *) dw) >= heap && ((stackitem *) dw) < end) {
+	    if (((char *) dw) < ((char *) p)) {
+		if (((char *) p) > (char *) (((stackitem *) dw) + Dictwordl) &&
+		    Isdef(dw))
+		    return dw;
+		break;
+	    }
+	    end = (stackitem *) dw;
+	}
+    }
+    return NULL;
+}
+
+/*  WBRUNS  --  Return a word named as called if it runs the code of
+		the given definition, or of any if that's NULL: if it's
+		the definition, or a word made by its DOES> clause.
+		Otherwise, or if it isn't a word on the heap at all,
+		return NULL.  */
+
+static dictword *wbruns(dw, cw)
+  dictword *dw, *cw;
+{
+    if (((stackitem *) dw) < heap || ((stackitem *) dw) >= hptr ||
+	(((stackitem) dw) % sizeof(stackitem)) != 0)
+	return NULL;
+    if (dw->wcode == P_dodoes) {
+	atl_token *clause = *((atl_token **) (((stackitem *) dw) - 1));
+
+	return (cw == NULL || wbcode(clause) == cw) ? dw : NULL;
+    }
+    return (Isdef(dw) && (cw == NULL || dw == cw)) ? dw : NULL;
+}
+
+/*  PWALKBACK  --  Print walkback trace.  */
+
+static void pwalkback()
+{
+    atl_token *pos = ip;	      /* Where the frame's code has reached */
+    rstackitem *rp = rstk;
+    Boolean head = False;
+
+    if (!atl_walkback)
+	return;
+    if (curword != NULL) {
+        V printf("Walkback:\n");
+        V printf("   %s\n", curword->wname + 1);
+	head = True;
+    }
+    while (rp > rstack) {
+	atl_token *r;
+	dictword *cw, *fw;
+	atl_wblevel *lv;
+
+	for (lv = wblevel; lv != NULL; lv = lv->lprev) {
+	    if (lv->lword == NULL && lv->lrstk == rp)
+		pos = lv->lip;	      /* EVALUATE was called from here */
+	}
+	r = *(--rp);
+	cw = wbcode(pos);
+	for (lv = wblevel; lv != NULL; lv = lv->lprev) {
+	    if (lv->lword != NULL && lv->lrstk == rp && lv->lip == r)
+		break;
+	}
+	if (lv != NULL) {
+	    fw = lv->lword;	      /* Word exword() was called to run */
+#ifdef TASKS
+	} else if (curtask != NULL && r == curtask->tcode + 1) {
+	    fw = Tokword(curtask->tcode[0]); /* Word the task began with */
+#endif
+	} else if (wbcode(r) != NULL) {
+	    fw = Tokword(r[-1]);      /* Word named at the call */
+	    if (wbruns(fw, cw) == NULL && cw != NULL && wbcode(r) == cw)
+		continue;	      /* A loop exit address */
+	} else {
+	    continue;		      /* Not a return address */
+	}
+	if (wbruns(fw, cw) == NULL)
+	    fw = cw;		      /* It was tail called, or unknown */
+	pos = r;
+	if (fw != NULL) {
+	    if (!head) {
+                V printf("Walkback:\n");
+		head = True;
+	    }
+            V printf("   %s\n", fw->wname + 1);
+	}
+    }
+}
+#endif /* RSWALKBACK */
 #endif /* WALKBACK */
 
 /*  TROUBLE  --  Common handler for serious errors.  */
@@ -3051,6 +6067,13 @@ static void pwalkback()
 static void trouble(kind)
   char *kind;
 {
+#ifdef CATCH
+    /* Within CATCH, the error is thrown to it with its status, or as
+       an application error if it has none.  A break is not caught. */
+    if (catchp != NULL && evalstat != ATL_BREAK)
+	throwcode((stackitem) (evalstat != ATL_SNORM ? evalstat :
+					    ATL_APPLICATION));
+#endif
 #ifdef MEMMESSAGE
     V printf("\n%s.\n", kind);
 #endif
@@ -3068,8 +6091,8 @@ static void trouble(kind)
 Exported void atl_error(kind)
   char *kind;
 {
-    trouble(kind);
     evalstat = ATL_APPLICATION;       /* Signify application-detected error */
+    trouble(kind);
 }
 
 #ifndef NOMEMCHECK
@@ -3078,32 +6101,32 @@ Exported void atl_error(kind)
 
 Exported void stakover()
 {
-    trouble("Stack overflow");
     evalstat = ATL_STACKOVER;
+    trouble("Stack overflow");
 }
 
 /*  STAKUNDER  --  Recover from stack underflow.  */
 
 Exported void stakunder()
 {
-    trouble("Stack underflow");
     evalstat = ATL_STACKUNDER;
+    trouble("Stack underflow");
 }
 
 /*  RSTAKOVER  --  Recover from return stack overflow.	*/
 
 Exported void rstakover()
 {
-    trouble("Return stack overflow");
     evalstat = ATL_RSTACKOVER;
+    trouble("Return stack overflow");
 }
 
 /*  RSTAKUNDER	--  Recover from return stack underflow.  */
 
 Exported void rstakunder()
 {
-    trouble("Return stack underflow");
     evalstat = ATL_RSTACKUNDER;
+    trouble("Return stack underflow");
 }
 
 /*  HEAPOVER  --  Recover from heap overflow.  Note that a heap
@@ -3113,84 +6136,1142 @@ Exported void rstakunder()
 
 Exported void heapover()
 {
-    trouble("Heap overflow");
     evalstat = ATL_HEAPOVER;
+    trouble("Heap overflow");
 }
 
 /*  BADPOINTER	--  Abort if bad pointer reference detected.  */
 
 Exported void badpointer()
 {
-    trouble("Bad pointer");
     evalstat = ATL_BADPOINTER;
+    trouble("Bad pointer");
 }
 
 /*  NOTCOMP  --  Compiler word used outside definition.  */
 
 static void notcomp()
 {
-    trouble("Compiler word outside definition");
     evalstat = ATL_NOTINDEF;
+    trouble("Compiler word outside definition");
 }
 
 /*  DIVZERO  --  Attempt to divide by zero.  */
 
 static void divzero()
 {
-    trouble("Divide by zero");
     evalstat = ATL_DIVZERO;
+    trouble("Divide by zero");
 }
 
 #endif /* !NOMEMCHECK */
 
-/*  EXWORD  --	Execute a word (and any sub-words it may invoke). */
+#ifdef VERIFY
+
+/*  Stack effects of the primitives the verifier understands, other
+    than those which take in-line operands or change the flow of
+    control, which verify() handles itself.  */
+
+static const struct primfx {
+    codeptr fcode;		      /* Primitive function */
+    signed char fin, fout;	      /* Stack items taken and left */
+    signed char frneed, frnet;	      /* Return stack items needed, change */
+} primfx[] = {
+    {P_plus, 2, 1, 0, 0},
+    {P_minus, 2, 1, 0, 0},
+    {P_times, 2, 1, 0, 0},
+    {P_div, 2, 1, 0, 0},
+    {P_mod, 2, 1, 0, 0},
+    {P_divmod, 2, 2, 0, 0},
+    {P_min, 2, 1, 0, 0},
+    {P_max, 2, 1, 0, 0},
+    {P_neg, 1, 1, 0, 0},
+    {P_abs, 1, 1, 0, 0},
+    {P_equal, 2, 1, 0, 0},
+    {P_unequal, 2, 1, 0, 0},
+    {P_gtr, 2, 1, 0, 0},
+    {P_lss, 2, 1, 0, 0},
+    {P_geq, 2, 1, 0, 0},
+    {P_leq, 2, 1, 0, 0},
+    {P_and, 2, 1, 0, 0},
+    {P_or, 2, 1, 0, 0},
+    {P_xor, 2, 1, 0, 0},
+    {P_not, 1, 1, 0, 0},
+    {P_shift, 2, 1, 0, 0},
+    {P_depth, 0, 1, 0, 0},
+    {P_dup, 1, 2, 0, 0},
+    {P_drop, 1, 0, 0, 0},
+    {P_swap, 2, 2, 0, 0},
+    {P_over, 2, 3, 0, 0},
+    {P_rot, 3, 3, 0, 0},
+    {P_minusrot, 3, 3, 0, 0},
+    {P_tor, 1, 0, 0, 1},
+    {P_rfrom, 0, 1, 1, -1},
+    {P_rfetch, 0, 1, 1, 0},
+    {P_i, 0, 1, 3, 0},
+    {P_j, 0, 1, 6, 0},
+#ifdef SHORTCUTA
+    {P_1plus, 1, 1, 0, 0},
+    {P_2plus, 1, 1, 0, 0},
+    {P_1minus, 1, 1, 0, 0},
+    {P_2minus, 1, 1, 0, 0},
+    {P_2times, 1, 1, 0, 0},
+    {P_2div, 1, 1, 0, 0},
+#endif
+#ifdef SHORTCUTC
+    {P_0equal, 1, 1, 0, 0},
+    {P_0notequal, 1, 1, 0, 0},
+    {P_0gtr, 1, 1, 0, 0},
+    {P_0lss, 1, 1, 0, 0},
+#endif
+#ifdef DOUBLE
+    {P_2dup, 2, 4, 0, 0},
+    {P_2drop, 2, 0, 0, 0},
+    {P_2swap, 4, 4, 0, 0},
+    {P_2over, 4, 6, 0, 0},
+    {P_2rot, 6, 6, 0, 0},
+    {P_2bang, 3, 0, 0, 0},
+    {P_2at, 1, 2, 0, 0},
+    {P_2con, 0, 2, 0, 0},
+#endif
+    {P_bang, 2, 0, 0, 0},
+    {P_at, 1, 1, 0, 0},
+    {P_plusbang, 2, 0, 0, 0},
+    {P_cbang, 2, 0, 0, 0},
+    {P_cat, 1, 1, 0, 0},
+    {P_here, 0, 1, 0, 0},
+#ifdef MEMPOOL
+    {P_allocate, 1, 2, 0, 0},
+    {P_free, 1, 1, 0, 0},
+    {P_resize, 2, 2, 0, 0},
+#endif
+#ifdef CATCH
+    {P_throw, 1, 0, 0, 0},
+#endif
+    {P_var, 0, 1, 0, 0},
+    {P_con, 0, 1, 0, 0},
+#ifdef PEEPHOLE
+    {P_litplus, 1, 1, 0, 0},
+    {P_litat, 0, 1, 0, 0},
+    {P_litbang, 1, 0, 0, 0},
+    {P_iplus, 1, 1, 3, 0},
+#endif
+#ifdef REAL
+    {P_fplus, 2 * Realsize, Realsize, 0, 0},
+    {P_fminus, 2 * Realsize, Realsize, 0, 0},
+    {P_ftimes, 2 * Realsize, Realsize, 0, 0},
+    {P_fdiv, 2 * Realsize, Realsize, 0, 0},
+    {P_fneg, Realsize, Realsize, 0, 0},
+    {P_fabs, Realsize, Realsize, 0, 0},
+    {P_float, 1, Realsize, 0, 0},
+    {P_fix, Realsize, 1, 0, 0},
+#endif
+#ifdef CONIO
+    {P_dot, 1, 0, 0, 0},
+    {P_question, 1, 0, 0, 0},
+    {P_cr, 0, 0, 0, 0},
+    {P_type, 1, 0, 0, 0},
+#endif
+    {NULL, 0, 0, 0, 0}
+};
 
-static void exword(wp)
-  dictword *wp;
+/*  VTWIN  --  Return the unchecked copy of a primitive, or NULL if it
+	       has none.  */
+
+static dictword *vtwin(dw)
+  dictword *dw;
 {
-    curword = wp;
-#ifdef TRACE
-    if (atl_trace) {
-        V printf("\nTrace: %s ", curword->wname + 1);
-    }
-#endif /* TRACE */
-    (*curword->wcode)();	      /* Execute the first word */
-    while (ip != NULL) {
-#ifdef BREAK
-#ifdef Keybreak
-	Keybreak();		      /* Poll for asynchronous interrupt */
-#endif
-	if (broken) {		      /* Did we receive a break signal */
-            trouble("Break signal");
-	    evalstat = ATL_BREAK;
-	    break;
-	}
-#endif /* BREAK */
-	curword = *ip++;
-#ifdef TRACE
-	if (atl_trace) {
-            V printf("\nTrace: %s ", curword->wname + 1);
-	}
-#endif /* TRACE */
-	(*curword->wcode)();	      /* Execute the next word */
+    unsigned long i = (unsigned long) (dw - primbase), k;
+
+    if (i >= ELEMENTS(primt) - 1 || (primt[i].pname[0] & WORDHIDDEN))
+	return NULL;
+    for (k = i + 1; k < ELEMENTS(primt) - 1; k++) {
+	if (primt[k].pcode == primt[i].pcode &&
+	    (primt[k].pname[0] & WORDHIDDEN))
+	    return primbase + k;
     }
-    curword = NULL;
-}
+    return NULL;
+}
+
+/*  VERIFY  --  Work out the effect on the stacks of the definition
+		; is completing.  The code is followed through in
+		address order, tracking the stack depths relative to
+		entry, which must be the same whichever way a point
+		is reached, and each word must be a primitive in
+		primfx[] or one verify() understands, or a verified
+		definition.  If all is well, the checked primitives
+		are replaced with their unchecked copies, the effect
+		is stored in a cell before the code, and True is
+		returned so ; will install P_vnest to check the
+		stacks once on entry.  */
+
+#define Fxdead	(-32767)	      /* Depth of a point not yet reached */
+#define Fxloops 8		      /* Deepest nesting of DO loops */
+
+struct vpoint {
+    short vd, vr;		      /* Stack depths at this point */
+    char vtok;			      /* A word is compiled here */
+};
 
-/*  ATL_INIT  --  Initialise the ATLAST system.  The dynamic storage areas
-		  are allocated unless the caller has preallocated buffers
-		  for them and stored the addresses into the respective
-		  pointers.  In either case, the storage management
-		  pointers are initialised to the correct addresses.  If
-                  the caller preallocates the buffers, it's up to him to
-		  ensure that the length allocated agrees with the lengths
-		  given by the atl_... cells.  */
+/*  VJOIN  --  Record the stack depths with which a point is reached,
+	       returning False if it was reached before with others.  */
 
-void atl_init()
+static Boolean vjoin(vp, d, r)
+  struct vpoint *vp;
+  int d, r;
 {
+    if (vp->vd == Fxdead) {
+	vp->vd = d;
+	vp->vr = r;
+	return True;
+    }
+    return vp->vd == d && vp->vr == r;
+}
+
+static Boolean verify(dw)
+  dictword *dw;
+{
+    atl_token *body = (atl_token *) (((stackitem *) dw) + Dictwordl),
+	      *end = Chere, *p, *q, *t;
+    atl_token *loopx[Fxloops];	      /* Exits of DO loops in progress */
+    struct vpoint *vp;
+    long n = end - body, k;
+    int d = 0, r = 0, dmin = 0, dmax = 0, rmax = 0, net = 0, nloop = 0;
+    Boolean live = True, exits = False, ok = True;
+    stackitem *hp;
+
+    if (n <= 0 || (hptr + 1) > heaptop ||
+	(vp = (struct vpoint *) malloc(n * sizeof(struct vpoint))) == NULL)
+	return False;
+    for (k = 0; k < n; k++) {
+	vp[k].vd = Fxdead;
+	vp[k].vtok = 0;
+    }
+
+    for (p = body; ok && p < end; p = q) {
+	dictword *w = Tokword(*p);
+	codeptr c = w->wcode;
+
+	q = tokskip(p + 1, c);
+	t = Vbranch(c) ? p + 1 + Tokoff(p + 1) : NULL;
+	vp[p - body].vtok = 1;
+	if (live) {
+	    ok = vjoin(&vp[p - body], d, r);
+	} else if (vp[p - body].vd != Fxdead) {
+	    live = True;	      /* The target of an earlier branch */
+	    d = vp[p - body].vd;
+	    r = vp[p - body].vr;
+	}
+	if (!ok || !live)
+	    continue;
+	if (t != NULL && (t < body || t >= end ||
+		(t <= p && vp[t - body].vd == Fxdead))) {
+	    ok = False; 	      /* Branch out of the word or back to
+					 a point we haven't reached */
+	    continue;
+	}
+
+	if (c == P_branch) {
+	    ok = vjoin(&vp[t - body], d, r);
+	    live = False;
+	} else if (c == P_qbranch) {
+	    d--;
+	    ok = vjoin(&vp[t - body], d, r);
+#ifdef PEEPHOLE
+	} else if (c == P_zqbranch) {
+	    d--;
+	    ok = vjoin(&vp[t - body], d, r);
+	} else if (c == P_dupqbranch) {
+	    dmin = min(dmin, d - 1);
+	    ok = vjoin(&vp[t - body], d, r);
+#endif
+	} else if (c == P_xdo || c == P_xqdo) {
+	    d -= 2;
+	    if (c == P_xqdo)
+		ok = vjoin(&vp[t - body], d, r);
+	    if (nloop < Fxloops)
+		loopx[nloop++] = t;
+	    else
+		ok = False;
+	    r += 3;
+	} else if (c == P_xloop || c == P_xploop) {
+	    if (c == P_xploop)
+		d--;
+	    ok = r >= 3 && nloop > 0 && vjoin(&vp[t - body], d, r);
+	    r -= 3;
+	    nloop--;
+	} else if (c == P_leave) {
+	    ok = r >= 3 && nloop > 0 &&
+		 loopx[nloop - 1] < end &&
+		 vjoin(&vp[loopx[nloop - 1] - body], d, r - 3);
+	    live = False;
+	} else if (c == P_exit) {
+	    ok = r == 0 && (!exits || d == net);
+	    net = d;
+	    exits = True;
+	    live = False;
+#ifdef TAILCALL
+	} else if (c == P_tail) {
+	    dictword *tw = Tokword(p[1]);
+	    stackitem fx;
+
+	    if (tw->wcode != P_vnest) {
+		ok = False;	      /* Including a call of itself */
+		continue;
+	    }
+	    fx = *(((stackitem *) tw) + Dictwordl);
+	    dmin = min(dmin, d - Fxneed(fx));
+	    dmax = max(dmax, d + Fxgrow(fx));
+	    rmax = max(rmax, r + Fxrgrow(fx));
+	    d += Fxnet(fx);
+	    ok = r == 0 && (!exits || d == net);
+	    net = d;
+	    exits = True;
+	    live = False;
+#endif
+	} else if (c == P_dolit) {
+	    d++;
+#ifdef TOKTHREAD
+	} else if (c == P_doslit) {
+	    d++;
+#endif
+#ifdef STRING
+	} else if (c == P_strlit) {
+	    d++;
+#endif
+#ifdef REAL
+	} else if (c == P_flit) {
+	    d += Realsize;
+#endif
+#ifdef CONIO
+	} else if (c == P_dotparen) {
+	    /* Prints its in-line string */
+#endif
+	} else if (c == P_vnest) {
+	    stackitem fx = *(((stackitem *) w) + Dictwordl);
+
+	    dmin = min(dmin, d - Fxneed(fx));
+	    dmax = max(dmax, d + Fxgrow(fx));
+	    rmax = max(rmax, r + Fxrgrow(fx));
+	    d += Fxnet(fx);
+	} else {
+	    const struct primfx *fp = primfx;
+
+	    while (fp->fcode != NULL && fp->fcode != c)
+		fp++;
+	    /* A definition that calls itself finds its own item still
+	       bearing the P_var code CREATE gave it. */
+	    if (fp->fcode == NULL || r < fp->frneed || w == dw) {
+		ok = False;
+		continue;
+	    }
+	    dmin = min(dmin, d - fp->fin);
+	    d += fp->fout - fp->fin;
+	    r += fp->frnet;
+	}
+	dmax = max(dmax, d);
+	rmax = max(rmax, r);
+	dmin = min(dmin, d);
+    }
+
+    /* Every branch must land on a word, and the code can't run off
+       its end. */
+
+    for (k = 0; ok && k < n; k++)
+	ok = vp[k].vd == Fxdead || vp[k].vtok;
+    free((char *) vp);
+    if (!ok || live || !exits || -dmin > 255 || dmax > 255 ||
+	rmax + 1 > 255 || net < -128 || net > 127)
+	return False;
+
+    for (p = body; p < end; p = q) {
+	dictword *w = Tokword(*p), *tw = vtwin(w);
+
+	q = tokskip(p + 1, w->wcode);
+	if (tw != NULL)
+	    *p = Wordtok(tw);
+    }
+
+    /* Move the code up a cell to make room for the effect. */
+
+    for (hp = hptr - 1; hp >= (stackitem *) body; hp--)
+	*(hp + 1) = *hp;
+    hptr++;
+#ifdef TOKTHREAD
+    tokhptr = NULL;
+#endif
+    *((stackitem *) body) = Fxpack(-dmin, dmax, rmax + 1, net);
+    return True;
+}
+#endif /* VERIFY */
+
+/*  EXWORD  --	Execute a word (and any sub-words it may invoke). */
+
+#ifdef DIRECTTHREAD
+
+/*  This version of exword() is a direct-threaded inner interpreter.
+    The hot core primitives are expanded inline as labelled blocks
+    within this one function, and each compiled word is dispatched
+    with a computed goto rather than an indirect call through the
+    word's wcode.  Since the built-in primitives are allocated as
+    one block by atl_primdef(), a word's offset from the start of
+    that block indexes the table of labels.  Colon definitions,
+    variables, and constants are recognised by their wcode, and
+    every other word (including application primitives defined by
+    the calling program) is called through its wcode exactly as
+    in the portable interpreter below.
+
+    The inline primitives must behave exactly like their functions
+    above.  The checks below are those of atldef.h except that,
+    since the error handlers have already cleared ip when we get
+    control back, they resume at the top of the loop instead of
+    returning. */
+
+#ifdef NOMEMCHECK
+#define Isl(x)
+#define Iso(n)
+#define Irsl(x)
+#define Irso(n)
+#define Ihpc(n)
+#else
+#define Isl(x) if ((stk-stack)<(x)) {stakunder(); goto next;}
+#define Iso(n) Mss(n) if ((stk+(n))>stacktop) {stakover(); goto next;}
+#define Irsl(x) if ((rstk-rstack)<(x)) {rstakunder(); goto next;}
+#define Irso(n) Msr(n) if ((rstk+(n))>rstacktop) {rstakover(); goto next;}
+#define Ihpc(n) if ((((stackitem *)(n))<heapbot)||(((stackitem *)(n))>=heaptop)){badpointer(); goto next;}
+#endif
+
+/* With VERIFY, the unchecked copy of an inline primitive enters it
+   after its stack checks. */
+
+#ifdef VERIFY
+#define Unchecked(l) l:
+#else
+#define Unchecked(l)
+#endif
+
+static void exword(wp)
+  dictword *wp;
+{
+    static void *optab[ELEMENTS(primt) - 1]; /* Labels for primt[] items */
+    static Boolean opinit = False;
+    unsigned long i;
+#ifdef RSWALKBACK
+    atl_wblevel lv;
+#endif
+
+    if (!opinit) {
+	static const codeptr infn[] = {
+	    P_exit, P_dolit, P_branch, P_qbranch, P_xdo, P_xqdo,
+	    P_xloop, P_xploop, P_i, P_j, P_plus, P_minus, P_times,
+	    P_dup, P_drop, P_swap, P_over, P_rot, P_tor, P_rfrom,
+	    P_at, P_bang, P_equal, P_lss, P_gtr, P_and, P_or,
+#ifdef SHORTCUTA
+	    P_1plus, P_1minus,
+#endif
+#ifdef SHORTCUTC
+	    P_0equal,
+#endif
+#ifdef TOKTHREAD
+	    P_doslit,
+#endif
+#ifdef PEEPHOLE
+	    P_litplus, P_litat, P_litbang, P_dupqbranch, P_zqbranch,
+	    P_iplus,
+#ifdef DOUBLE
+	    P_2dup,
+#endif
+#endif
+#ifdef TAILCALL
+	    P_tail,
+#endif
+	    NULL
+	};
+	static void *const inlab[] = {
+	    &&x_exit, &&x_dolit, &&x_branch, &&x_qbranch, &&x_xdo,
+	    &&x_xqdo, &&x_xloop, &&x_xploop, &&x_i, &&x_j, &&x_plus,
+	    &&x_minus, &&x_times, &&x_dup, &&x_drop, &&x_swap,
+	    &&x_over, &&x_rot, &&x_tor, &&x_rfrom, &&x_at, &&x_bang,
+	    &&x_equal, &&x_lss, &&x_gtr, &&x_and, &&x_or,
+#ifdef SHORTCUTA
+	    &&x_1plus, &&x_1minus,
+#endif
+#ifdef SHORTCUTC
+	    &&x_0equal,
+#endif
+#ifdef TOKTHREAD
+	    &&x_doslit,
+#endif
+#ifdef PEEPHOLE
+	    &&x_litplus, &&x_litat, &&x_litbang, &&x_dupqbranch,
+	    &&x_zqbranch, &&x_iplus,
+#ifdef DOUBLE
+	    &&x_2dup,
+#endif
+#endif
+#ifdef TAILCALL
+	    &&x_tail,
+#endif
+	    NULL
+	};
+#ifdef VERIFY
+	static void *const unlab[] = { /* Unchecked copies of the above */
+	    &&u_exit, &&u_dolit, &&x_branch, &&u_qbranch, &&u_xdo,
+	    &&u_xqdo, &&u_xloop, &&u_xploop, &&u_i, &&u_j, &&u_plus,
+	    &&u_minus, &&u_times, &&u_dup, &&u_drop, &&u_swap,
+	    &&u_over, &&u_rot, &&u_tor, &&u_rfrom, &&u_at, &&u_bang,
+	    &&u_equal, &&u_lss, &&u_gtr, &&u_and, &&u_or,
+#ifdef SHORTCUTA
+	    &&u_1plus, &&u_1minus,
+#endif
+#ifdef SHORTCUTC
+	    &&u_0equal,
+#endif
+#ifdef TOKTHREAD
+	    &&u_doslit,
+#endif
+#ifdef PEEPHOLE
+	    &&u_litplus, &&u_litat, &&u_litbang, &&u_dupqbranch,
+	    &&u_zqbranch, &&u_iplus,
+#ifdef DOUBLE
+	    &&u_2dup,
+#endif
+#endif
+#ifdef TAILCALL
+	    &&x_tail,
+#endif
+	    NULL
+	};
+#endif /* VERIFY */
+	int j;
+
+	for (i = 0; i < ELEMENTS(optab); i++) {
+	    optab[i] = &&x_call;
+	    for (j = 0; infn[j] != NULL; j++) {
+		if (primt[i].pcode == infn[j]) {
+		    optab[i] = inlab[j];
+#ifdef VERIFY
+		    if (primt[i].pname[0] & WORDHIDDEN)
+			optab[i] = unlab[j];
+#endif
+		    break;
+		}
+	    }
+	}
+	opinit = True;
+    }
+    if (wp == NULL)
+	return; 		      /* atl_init() only wants optab built */
+
+#ifdef RSWALKBACK
+    lv.lprev = wblevel;
+    lv.lword = wp;
+    lv.lip = ip;
+    lv.lrstk = rstk;
+    wblevel = &lv;
+#endif
+    curword = wp;
+#ifdef TRACE
+    if (atl_trace) {
+        V printf("\nTrace: %s ", curword->wname + 1);
+    }
+#endif /* TRACE */
+    Profword();
+    goto dispatch;		      /* Execute the first word */
+
+next:
+    if (ip == NULL) {
+#ifdef TASKS
+	if (taskexit())
+	    goto next;		      /* Carry on with the next task */
+#endif
+	goto done;
+    }
+#ifdef BREAK
+#ifdef Keybreak
+    Keybreak(); 		      /* Poll for asynchronous interrupt */
+#endif
+    if (broken) {		      /* Did we receive a break signal */
+#ifdef TASKS
+	if (curtask != fgtask && evaldepth != taskdepth) {
+	    evalstat = ATL_BREAK;     /* Unwind the task's inner level */
+	    goto done;
+	}
+	taskkill();		      /* A break ends all tasks */
+#endif
+	evalstat = ATL_BREAK;
+	trouble("Break signal");
+	goto done;
+    }
+#endif /* BREAK */
+#ifdef TOKTHREAD
+    i = (unsigned long) (*ip - Tokprim); /* primt[] token = optab index */
+    curword = (i < ELEMENTS(optab)) ? primbase + i : Tokword(*ip);
+#else
+    curword = *ip;
+#endif
+    ip++;
+#ifdef TRACE
+    if (atl_trace) {
+        V printf("\nTrace: %s ", curword->wname + 1);
+    }
+#endif /* TRACE */
+    Profword();
+#ifdef TOKTHREAD
+    if (i < ELEMENTS(optab))
+	goto *optab[i];
+    goto dispatchword;
+#endif
+
+dispatch:
+    i = (unsigned long) (curword - primbase);
+    if (i < ELEMENTS(optab))
+	goto *optab[i];
+#ifdef TOKTHREAD
+dispatchword:
+#endif
+    if (curword->wcode == P_nest)
+	goto x_nest;
+#ifdef VERIFY
+    if (curword->wcode == P_vnest)
+	goto x_vnest;
+#endif
+    if (curword->wcode == P_con)
+	goto x_con;
+    if (curword->wcode == P_var)
+	goto x_var;
+
+x_call: 			      /* Not expanded inline: call it */
+    (*curword->wcode)();
+    goto next;
+
+x_nest:
+    Irso(1);
+#ifdef WBSTACK
+    *wbptr++ = curword; 	      /* Place word on walkback stack */
+#endif
+    Rpush = ip; 		      /* Push instruction pointer */
+    ip = (atl_token *) (((stackitem *) curword) + Dictwordl);
+    Profnest();
+    goto next;
+
+#ifdef VERIFY
+x_vnest:
+    {
+	stackitem fx = *(((stackitem *) curword) + Dictwordl);
+
+	Isl(Fxneed(fx));
+	Iso(Fxgrow(fx));
+	Irso(Fxrgrow(fx));
+    }
+#ifdef WBSTACK
+    *wbptr++ = curword; 	      /* Place word on walkback stack */
+#endif
+    Rpush = ip; 		      /* Push instruction pointer */
+    ip = (atl_token *) (((stackitem *) curword) + Dictwordl + 1);
+    Profnest();
+    goto next;
+#endif /* VERIFY */
+
+#ifdef TAILCALL
+x_tail:
+    curword = Tokword(*ip);
+#ifdef TRACE
+    if (atl_trace) {
+        V printf("%s ", curword->wname + 1);
+    }
+#endif
+    Profword();
+    if (curword->wcode == P_nest) {
+	ip = (atl_token *) (((stackitem *) curword) + Dictwordl);
+#ifdef VERIFY
+    } else if (curword->wcode == P_vnest) {
+	stackitem fx = *(((stackitem *) curword) + Dictwordl);
+
+	Isl(Fxneed(fx));
+	Iso(Fxgrow(fx));
+	Irso(Fxrgrow(fx) - 1);
+	ip = (atl_token *) (((stackitem *) curword) + Dictwordl + 1);
+#endif
+    } else {
+	Irsl(1);		      /* Return, then dispatch the word */
+#ifdef WBSTACK
+	wbptr = (wbptr > wback) ? wbptr - 1 : wback;
+#endif
+	ip = R0;
+	Rpop;
+	Profexit();
+	goto dispatch;
+    }
+#ifdef WBSTACK
+    if (wbptr > wback)
+	wbptr[-1] = curword;
+#endif
+    Proftail();
+    goto next;
+#endif /* TAILCALL */
+
+x_exit:
+    Irsl(1);
+Unchecked(u_exit)
+#ifdef WBSTACK
+    wbptr = (wbptr > wback) ? wbptr - 1 : wback;
+#endif
+    ip = R0;			      /* Set IP to top of return stack */
+    Rpop;
+    Profexit();
+    goto next;
+
+x_con:
+    Iso(1);
+    Push = *(((stackitem *) curword) + Dictwordl);
+    goto next;
+
+x_var:
+    Iso(1);
+    Push = (stackitem) (((stackitem *) curword) + Dictwordl);
+    goto next;
+
+x_dolit:
+    Iso(1);
+Unchecked(u_dolit)
+    ip = Ipalign(ip);
+#ifdef TRACE
+    if (atl_trace) {
+        V printf("%ld ", (long) *((stackitem *) ip));
+    }
+#endif
+    Push = *((stackitem *) ip);
+    ip += Tokcell;
+    goto next;
+
+#ifdef TOKTHREAD
+x_doslit:
+    Iso(1);
+Unchecked(u_doslit)
+#ifdef TRACE
+    if (atl_trace) {
+        V printf("%ld ", (long) Ipoff);
+    }
+#endif
+    Push = Ipoff;
+    ip++;
+    goto next;
+#endif /* TOKTHREAD */
+
+x_branch:
+    ip += Ipoff;
+    goto next;
+
+x_qbranch:
+    Isl(1);
+Unchecked(u_qbranch)
+    if (S0 == 0)
+	ip += Ipoff;
+    else
+	ip++;
+    Pop;
+    goto next;
+
+x_xdo:
+    Isl(2);
+    Irso(3);
+Unchecked(u_xdo)
+    Rpush = ip + Ipoff;
+    ip++;
+    Rpush = (rstackitem) S1;
+    Rpush = (rstackitem) S0;
+    stk -= 2;
+    goto next;
+
+x_xqdo:
+    Isl(2);
+Unchecked(u_xqdo)
+    if (S0 == S1) {
+	ip += Ipoff;
+    } else {
+	Irso(3);
+	Rpush = ip + Ipoff;
+	ip++;
+	Rpush = (rstackitem) S1;
+	Rpush = (rstackitem) S0;
+    }
+    stk -= 2;
+    goto next;
+
+x_xloop:
+    Irsl(3);
+Unchecked(u_xloop)
+    R0 = (rstackitem) (((stackitem) R0) + 1);
+    if (((stackitem) R0) == ((stackitem) R1)) {
+	rstk -= 3;
+	ip++;
+    } else {
+	ip += Ipoff;
+    }
+    goto next;
+
+x_xploop:
+    {
+	stackitem niter;
+
+	Isl(1);
+	Irsl(3);
+Unchecked(u_xploop)
+	niter = ((stackitem) R0) + S0;
+	Pop;
+	if ((niter >= ((stackitem) R1)) &&
+	    (((stackitem) R0) < ((stackitem) R1))) {
+	    rstk -= 3;
+	    ip++;
+	} else {
+	    ip += Ipoff;
+	    R0 = (rstackitem) niter;
+	}
+    }
+    goto next;
+
+x_i:
+    Irsl(3);
+    Iso(1);
+Unchecked(u_i)
+    Push = (stackitem) R0;
+    goto next;
+
+x_j:
+    Irsl(6);
+    Iso(1);
+Unchecked(u_j)
+    Push = (stackitem) rstk[-4];
+    goto next;
+
+x_plus:
+    Isl(2);
+Unchecked(u_plus)
+    S1 += S0;
+    Pop;
+    goto next;
+
+x_minus:
+    Isl(2);
+Unchecked(u_minus)
+    S1 -= S0;
+    Pop;
+    goto next;
+
+x_times:
+    Isl(2);
+Unchecked(u_times)
+    S1 *= S0;
+    Pop;
+    goto next;
+
+x_dup:
+    Isl(1);
+    Iso(1);
+Unchecked(u_dup)
+    stk[0] = S0;
+    stk++;
+    goto next;
+
+x_drop:
+    Isl(1);
+Unchecked(u_drop)
+    Pop;
+    goto next;
+
+x_swap:
+    {
+	stackitem t;
+
+	Isl(2);
+Unchecked(u_swap)
+	t = S1;
+	S1 = S0;
+	S0 = t;
+    }
+    goto next;
+
+x_over:
+    Isl(2);
+    Iso(1);
+Unchecked(u_over)
+    stk[0] = S1;
+    stk++;
+    goto next;
+
+x_rot:
+    {
+	stackitem t;
+
+	Isl(3);
+Unchecked(u_rot)
+	t = S0;
+	S0 = S2;
+	S2 = S1;
+	S1 = t;
+    }
+    goto next;
+
+x_tor:
+    Irso(1);
+    Isl(1);
+Unchecked(u_tor)
+    Rpush = (rstackitem) S0;
+    Pop;
+    goto next;
+
+x_rfrom:
+    Irsl(1);
+    Iso(1);
+Unchecked(u_rfrom)
+    Push = (stackitem) R0;
+    Rpop;
+    goto next;
+
+x_at:
+    Isl(1);
+Unchecked(u_at)
+    Ihpc(S0);
+    S0 = *((stackitem *) S0);
+    goto next;
+
+x_bang:
+    Isl(2);
+Unchecked(u_bang)
+    Ihpc(S0);
+    *((stackitem *) S0) = S1;
+    Pop2;
+    goto next;
+
+x_equal:
+    Isl(2);
+Unchecked(u_equal)
+    S1 = (S1 == S0) ? Truth : Falsity;
+    Pop;
+    goto next;
+
+x_lss:
+    Isl(2);
+Unchecked(u_lss)
+    S1 = (S1 < S0) ? Truth : Falsity;
+    Pop;
+    goto next;
+
+x_gtr:
+    Isl(2);
+Unchecked(u_gtr)
+    S1 = (S1 > S0) ? Truth : Falsity;
+    Pop;
+    goto next;
+
+x_and:
+    Isl(2);
+Unchecked(u_and)
+    S1 &= S0;
+    Pop;
+    goto next;
+
+x_or:
+    Isl(2);
+Unchecked(u_or)
+    S1 |= S0;
+    Pop;
+    goto next;
+
+#ifdef SHORTCUTA
+x_1plus:
+    Isl(1);
+Unchecked(u_1plus)
+    S0++;
+    goto next;
+
+x_1minus:
+    Isl(1);
+Unchecked(u_1minus)
+    S0--;
+    goto next;
+#endif /* SHORTCUTA */
+
+#ifdef SHORTCUTC
+x_0equal:
+    Isl(1);
+Unchecked(u_0equal)
+    S0 = (S0 == 0) ? Truth : Falsity;
+    goto next;
+#endif /* SHORTCUTC */
+
+#ifdef PEEPHOLE
+x_litplus:
+    Isl(1);
+Unchecked(u_litplus)
+    S0 += Ipoff;
+    ip++;
+    goto next;
+
+x_litat:
+    Iso(1);
+Unchecked(u_litat)
+    ip = Ipalign(ip);
+    Ihpc(*((stackitem *) ip));
+    Push = **((stackitem **) ip);
+    ip += Tokcell;
+    goto next;
+
+x_litbang:
+    Isl(1);
+Unchecked(u_litbang)
+    ip = Ipalign(ip);
+    Ihpc(*((stackitem *) ip));
+    **((stackitem **) ip) = S0;
+    Pop;
+    ip += Tokcell;
+    goto next;
+
+x_dupqbranch:
+    Isl(1);
+Unchecked(u_dupqbranch)
+    if (S0 == 0)
+	ip += Ipoff;
+    else
+	ip++;
+    goto next;
+
+x_zqbranch:
+    Isl(1);
+Unchecked(u_zqbranch)
+    if (S0 != 0)
+	ip += Ipoff;
+    else
+	ip++;
+    Pop;
+    goto next;
+
+x_iplus:
+    Irsl(3);
+    Isl(1);
+Unchecked(u_iplus)
+    S0 += (stackitem) R0;
+    goto next;
+
+#ifdef DOUBLE
+x_2dup:
+    Isl(2);
+    Iso(2);
+Unchecked(u_2dup)
+    stk[0] = S1;
+    stk[1] = S0;
+    stk += 2;
+    goto next;
+#endif
+#endif /* PEEPHOLE */
+
+done:
+    Profdone();
+    curword = NULL;
+#ifdef RSWALKBACK
+    wblevel = lv.lprev;
+#endif
+}
+
+#undef Isl
+#undef Iso
+#undef Irsl
+#undef Irso
+#undef Ihpc
+
+#else /* !DIRECTTHREAD */
+
+static void exword(wp)
+  dictword *wp;
+{
+#ifdef RSWALKBACK
+    atl_wblevel lv;
+
+    lv.lprev = wblevel;
+    lv.lword = wp;
+    lv.lip = ip;
+    lv.lrstk = rstk;
+    wblevel = &lv;
+#endif
+    curword = wp;
+#ifdef TRACE
+    if (atl_trace) {
+        V printf("\nTrace: %s ", curword->wname + 1);
+    }
+#endif /* TRACE */
+    Profword();
+    (*curword->wcode)();	      /* Execute the first word */
+    for (;;) {
+	while (ip != NULL) {
+#ifdef BREAK
+#ifdef Keybreak
+	    Keybreak(); 	      /* Poll for asynchronous interrupt */
+#endif
+	    if (broken) {	      /* Did we receive a break signal */
+#ifdef TASKS
+		if (curtask != fgtask && evaldepth != taskdepth) {
+		    evalstat = ATL_BREAK; /* Unwind the task's inner level */
+		    break;
+		}
+		taskkill();	      /* A break ends all tasks */
+#endif
+		evalstat = ATL_BREAK;
+		trouble("Break signal");
+		break;
+	    }
+#endif /* BREAK */
+	    curword = Tokword(*ip);
+	    ip++;
+#ifdef TRACE
+	    if (atl_trace) {
+                V printf("\nTrace: %s ", curword->wname + 1);
+	    }
+#endif /* TRACE */
+	    Profword();
+	    (*curword->wcode)();      /* Execute the next word */
+	}
+#ifdef TASKS
+	if ((ip == NULL) && taskexit())
+	    continue;		      /* Carry on with the next task */
+#endif
+	break;
+    }
+    Profdone();
+    curword = NULL;
+#ifdef RSWALKBACK
+    wblevel = lv.lprev;
+#endif
+}
+#endif /* DIRECTTHREAD */
+
+/*  ATL_INIT  --  Initialise the ATLAST system.  The dynamic storage areas
+		  are allocated unless the caller has preallocated buffers
+		  for them and stored the addresses into the respective
+		  pointers.  In either case, the storage management
+		  pointers are initialised to the correct addresses.  If
+                  the caller preallocates the buffers, it's up to him to
+		  ensure that the length allocated agrees with the lengths
+		  given by the atl_... cells.  */
+
+void atl_init()
+{
+#ifdef ROMDICT
+    if (s_exit == 0) {		      /* Not yet initialised */
+	atl_primdef(primt);	      /* Define primitive words */
+#ifdef DIRECTTHREAD
+	primbase = (dictword *) primt; /* Items are the primt[] entries */
+	exword(NULL);		      /* Build the label table now */
+#endif
+#else /* !ROMDICT */
     if (dict == NULL) {
 	atl_primdef(primt);	      /* Define primitive words */
 	dictprot = dict;	      /* Set protected mark in dictionary */
+#ifdef DIRECTTHREAD
+	primbase = dict;	      /* Items are in primt[] order */
+	exword(NULL);		      /* Build the label table now */
+#endif
+#endif /* ROMDICT */
 
 	/* Look up compiler-referenced words in the new dictionary and
 	   save their compile addresses in static variables. */
@@ -3208,6 +7289,26 @@ void atl_init()
         Cconst(s_xloop, "(XLOOP)");
         Cconst(s_pxloop, "(+XLOOP)");
         Cconst(s_abortq, "ABORT\"");
+#ifdef TASKS
+        Cconst(s_pause, "PAUSE");
+#endif
+#ifdef TOKTHREAD
+        Cconst(s_slit, "(SLIT)");
+#endif
+#ifdef PEEPHOLE
+        Cconst(s_litplus, "(LIT+)");
+        Cconst(s_litat, "(LIT@)");
+        Cconst(s_litbang, "(LIT!)");
+        Cconst(s_iplus, "(I+)");
+        Cconst(s_dupqbranch, "(DUP?BRANCH)");
+        Cconst(s_zqbranch, "(0=?BRANCH)");
+#ifdef DOUBLE
+        Cconst(s_2dup, "2DUP");
+#endif
+#endif
+#ifdef TAILCALL
+        Cconst(s_tail, "(TAIL)");
+#endif
 #undef Cconst
 
 	if (stack == NULL) {	      /* Allocate stack if needed */
@@ -3220,16 +7321,16 @@ void atl_init()
 #endif
 	stacktop = stack + atl_stklen;
 	if (rstack == NULL) {	      /* Allocate return stack if needed */
-	    rstack = (dictword ***)
+	    rstack = (rstackitem *)
 		alloc(((unsigned int) atl_rstklen) *
-		sizeof(dictword **));
+		sizeof(rstackitem));
 	}
 	rstk = rstackbot = rstack;
 #ifdef MEMSTAT
 	rstackmax = rstack;
 #endif
 	rstacktop = rstack + atl_rstklen;
-#ifdef WALKBACK
+#ifdef WBSTACK
 	if (wback == NULL) {
 	    wback = (dictword **) alloc(((unsigned int) atl_rstklen) *
 				    sizeof(dictword *));
@@ -3246,14 +7347,35 @@ void atl_init()
 
 	    int i;
 	    char *cp;
+	    unsigned int plen = 0;	      /* Length of the ALLOCATE pool */
+
+#ifdef MEMPOOL
+	    if (atl_poollen >= Poolpage)
+		plen = ((unsigned int) (atl_poollen / Poolpage)) * Poolpage;
+#endif
 
 	    /* Force length of temporary strings to even number of
-	       stackitems. */
-	    atl_ltempstr += sizeof(stackitem) -
-		(atl_ltempstr % sizeof(stackitem));
+	       stackitems.  A length that's already even is left alone,
+	       so initialising another instance doesn't grow it. */
+	    if ((atl_ltempstr % sizeof(stackitem)) != 0)
+		atl_ltempstr += sizeof(stackitem) -
+		    (atl_ltempstr % sizeof(stackitem));
 	    cp = alloc((((unsigned int) atl_heaplen) * sizeof(stackitem)) +
-			((unsigned int) (atl_ntempstr * atl_ltempstr)));
+			((unsigned int) (atl_ntempstr * atl_ltempstr)) + plen);
 	    heapbot = (stackitem *) cp;
+#ifdef MEMPOOL
+
+	    /* The ALLOCATE pool comes first, in whole pages, so it too
+	       lies within the heap extents. */
+
+	    if (plen > 0) {
+		pool = (atl_pool *) alloc(sizeof(atl_pool) +
+			    (plen / Poolpage - 1) * sizeof(poolpage));
+		pool->pbase = cp;
+		pool->pnpages = plen / Poolpage;
+		cp += plen;
+	    }
+#endif
 	    strbuf = (char **) alloc(((unsigned int) atl_ntempstr) *
 				sizeof(char *));
 	    for (i = 0; i < atl_ntempstr; i++) {
@@ -3263,6 +7385,12 @@ void atl_init()
 	    cstrbuf = 0;
 	    heap = (stackitem *) cp;  /* Allocatable heap starts after
 					 the temporary strings */
+
+	    /* Clear the heap, so space ALLOTted at startup holds the
+	       same thing every time and atl_include() finds the same
+	       state to key its caches by. */
+	    V memset((char *) heap, 0,
+		     ((unsigned int) atl_heaplen) * sizeof(stackitem));
 	}
 	/* The system state word is kept in the first word of the heap
            so that pointer checking doesn't bounce references to it.
@@ -3274,12 +7402,19 @@ void atl_init()
 	heapmax = hptr;
 #endif
 	heaptop = heap + atl_heaplen;
+#ifdef NAMEARENA
+	heapend = heaptop;
+#endif
+#ifdef MEMPOOL
+	if (pool != NULL)
+	    poolreset();	      /* Any blocks of a previous run are gone */
+#endif
 
 	/* Now that dynamic memory is up and running, allocate constants
 	   and variables built into the system.  */
 
 #ifdef FILEIO
-	{   static struct {
+	{   struct {
 #ifdef READONLYSTRINGS
         const
 #endif
@@ -3312,6 +7447,9 @@ void atl_init()
 	}
 #endif /* FILEIO */
 	dictprot = dict;	      /* Protect all standard words */
+#ifdef SNAPSHOT
+	heapprot = hptr;	      /* Snapshots start here */
+#endif
     }
 }
 
@@ -3345,6 +7483,9 @@ int atl_exec(dw)
   dictword *dw;
 {
     int sestat = evalstat, restat;
+#ifdef CATCH
+    atl_catch *scatch = catchp;       /* A THROW may not pass our caller */
+#endif
 
     evalstat = ATL_SNORM;
 #ifdef BREAK
@@ -3355,17 +7496,64 @@ int atl_exec(dw)
     Rso(1);
     Rpush = ip; 		      /* Push instruction pointer */
     ip = NULL;			      /* Keep exword from running away */
+#ifdef TASKS
+    evaldepth++;
+#endif
+#ifdef CATCH
+    catchp = NULL;
+#endif
     exword(dw);
+#ifdef CATCH
+    catchp = scatch;
+#endif
+#ifdef TASKS
+    evaldepth--;
+#endif
     if (evalstat == ATL_SNORM) {      /* If word ran to completion */
 	Rsl(1);
 	ip = R0;		      /* Pop the return stack */
 	Rpop;
     }
-#undef Memerrs
-#define Memerrs
-    restat = evalstat;
-    evalstat = sestat;
-    return restat;
+#undef Memerrs
+#define Memerrs
+    restat = evalstat;
+    evalstat = sestat;
+    return restat;
+}
+
+/*  ATL_DEFINED  --  Test whether a dictionary item is still a word,
+		     so an application holding one across a FORGET,
+		     marker or snapshot restore can tell if it has
+		     gone.  Words in the heap lie in the order they
+		     were defined, so one is gone if it lies past
+		     hptr, which the Forgotten hook sees restored; an
+		     address below hptr is taken to be a word without
+		     looking further.  Other items must be primitives,
+		     which are never forgotten, and are looked for
+		     among the protected words and ROM segments. */
+
+int atl_defined(dw)
+  dictword *dw;
+{
+    stackitem *sp = (stackitem *) dw;
+    dictword *p;
+#ifdef ROMDICT
+    int i;
+#endif
+
+    if (sp >= heap && sp < heaptop)
+	return (sp + Dictwordl <= hptr) ? True : False;
+#ifdef ROMDICT
+    for (i = 0; i < nromseg; i++) {
+	if (dw >= romseg[i].rbase && dw < romseg[i].rbase + romseg[i].rlen)
+	    return True;
+    }
+#endif
+    for (p = dictprot; p != NULL; p = p->wnext) {
+	if (p == dw)
+	    return True;
+    }
+    return False;
 }
 
 /*  ATL_VARDEF  --  Define a variable word.  Called with the word's
@@ -3422,6 +7610,7 @@ void atl_mark(mp)
 void atl_unwind(mp)
   atl_statemark *mp;
 {
+    dictword *odict;
 
     /* If atl_mark() was called before the system was initialised, and
        we've initialised since, we cannot unwind.  Just ignore the
@@ -3436,15 +7625,533 @@ void atl_unwind(mp)
     rstk = mp->mrstack; 	      /* Reset the return stack */
 
     /* To unwind the dictionary, we can't just reset the pointer,
-       we must walk back through the chain and release all the name
-       buffers attached to the items allocated after the mark was
-       made. */
+       we must release the name buffers attached to the items
+       allocated after the mark was made and drop them from the hash
+       index.  A mark made before dictprot unwinds only to it. */
+
+    odict = dict;
+    dictcut(userword(mp->mdict) ? mp->mdict : dictprot);
+#ifdef NAMEARENA
+    heaptop = nametop(dict);	      /* Release names of unwound words */
+#endif
+    heapcut(odict);
+}
+
+#ifdef SNAPSHOT
+
+/*  Dictionary snapshots.  ATL_SNAPSAVE copies the words defined since
+    atl_init() into an image which ATL_SNAPRESTORE loads into a freshly
+    initialised system, even one whose heap lies at another address or
+    whose program was rebuilt.  The image holds the heap cells of the
+    user words, a tag for each cell telling how to relocate it, and the
+    name strings.
+
+    Heap addresses are saved as byte offsets from the bottom of the
+    heap area, references to primitive words by name, and the code
+    fields of user words as an index in snapcode[].  The fields of the
+    dictionary items are tagged exactly; any other cell is classified
+    by its value, taking one which holds an address within the heap or
+    of a primitive's item to be a pointer.  An integer which happens to
+    equal such an address will be relocated along with it. */
+
+#define SnapMagic   0x504E5341L       /* Image identifier: "ASNP" */
+#define SnapVersion 1		      /* Image format version */
+
+#define SnapRaw     0		      /* Cell copied unchanged */
+#define SnapHeap    1		      /* Heap address: offset from heapbot */
+#define SnapPrim    2		      /* Primitive item: offset of name */
+#define SnapCode    3		      /* Code field: index in snapcode[] */
+#define SnapName    4		      /* Name field: offset of name */
+
+/* Top of the heap area, including any name arena */
+#ifdef NAMEARENA
+#define SnapTop     heapend
+#else
+#define SnapTop     heaptop
+#endif
 
-    while (dict != NULL && dict != dictprot && dict != mp->mdict) {
-	free(dict->wname);	      /* Release name string for item */
-	dict = dict->wnext;	      /* Link to previous item */
+/* Cell index of a field within a dictionary item */
+#define DfCell(fld) ((((char *) &(((dictword *) 0)->fld)) - ((char *) 0)) / \
+		     sizeof(stackitem))
+
+struct snaphdr {
+    long smagic;		      /* SnapMagic */
+    short sversion;		      /* SnapVersion */
+    short scell;		      /* Bytes per stack item */
+    long sitem; 		      /* Bytes per dictionary item */
+    long sheap; 		      /* Heap offset from heapbot */
+    long sbase; 		      /* First cell offset from heapbot */
+    long scells;		      /* Number of heap cells */
+    long sdict; 		      /* Newest word offset from heapbot */
+    long snames;		      /* Length of name strings */
+#ifdef TOKTHREAD
+    long sprims;		      /* Hash of primitive tokens' names */
+#endif
+};
+
+static const codeptr snapcode[] = {   /* Code fields of user words */
+    P_nest, P_var, P_con, P_dodoes,
+#ifdef DOUBLE
+    P_2con,
+#endif
+#ifdef ARRAY
+    P_arraysub,
+#endif
+#ifdef VERIFY
+    P_vnest,
+#endif
+    P_domarker,
+    NULL
+};
+
+/*  SNAPPRIM  --  If a value is the address of a primitive word's
+		  item, return the item.  Otherwise return NULL. */
+
+static dictword *snapprim(v)
+  stackitem v;
+{
+    dictword *dw;
+#ifdef ROMDICT
+    int i;
+
+    for (i = 0; i < nromseg; i++) {
+	const dictword *rb = romseg[i].rbase;
+
+	if (v >= (stackitem) rb && v < (stackitem) (rb + romseg[i].rlen) &&
+	    ((v - (stackitem) rb) % sizeof(dictword)) == 0)
+	    return (dictword *) v;
+    }
+#endif
+    for (dw = dictprot; dw != NULL; dw = dw->wnext) {
+	if ((stackitem) dw == v &&
+	    (((stackitem *) dw) < heapbot || ((stackitem *) dw) >= SnapTop))
+	    return dw;
+    }
+    return NULL;
+}
+
+#ifdef TOKTHREAD
+
+/*  SNAPTOKS  --  Hash the names of the primitives in token order.
+		  Compiled code refers to primitives by their position
+		  in the tables, so an image can be restored only by a
+		  system whose tables list the same words.  */
+
+static long snaptoks()
+{
+    unsigned long h = 5381;
+    int i, j;
+    char *cp;
+
+    for (i = 0; i < ntokseg; i++) {
+	for (j = 0; j < toklen[i]; j++) {
+	    for (cp = tokbase[i][j].wname + 1; *cp != EOS; cp++)
+		h = (h << 5) + h + ((unsigned char) *cp);
+	    h = (h << 5) + h;
+	}
+    }
+    return (long) (h & 0x7FFFFFFFL);
+}
+#endif /* TOKTHREAD */
+
+/*  SNAPSAVE  --  Save the heap from hbase up, and the words defined
+		  there, in an image in buf, if its length, buflen,
+		  allows.  The oldest of the words must follow older
+		  in the dictionary.  Returns the length of the image,
+		  or zero if the heap can't be saved now. */
+
+static long snapsave(hbase, older, buf, buflen)
+  stackitem *hbase;
+  dictword *older;
+  char *buf;
+  long buflen;
+{
+    struct snaphdr sh;
+    long ncells = hptr - hbase, nnames = 0, nprims = 0, len, i;
+    unsigned char *tags;
+    stackitem *cells;
+    dictword **prims, *dw;
+    long *primoff;
+    char *names;
+
+    if (state || heapprot == NULL || ncells < 0) /* Can't save a partial */
+	return 0;			      /* definition */
+
+    tags = (unsigned char *) alloc((unsigned int) (ncells + 1));
+    cells = (stackitem *) alloc((unsigned int) ((ncells + 1) * sizeof(stackitem)));
+    prims = (dictword **) alloc((unsigned int) ((ncells + 1) * sizeof(dictword *)));
+    primoff = (long *) alloc((unsigned int) ((ncells + 1) * sizeof(long)));
+
+    /* Classify every cell by its value. */
+
+    for (i = 0; i < ncells; i++) {
+	stackitem v = hbase[i];
+
+	cells[i] = v;
+	tags[i] = SnapRaw;
+	if (v >= (stackitem) heapbot && v < (stackitem) SnapTop) {
+	    tags[i] = SnapHeap;
+	    cells[i] = v - (stackitem) heapbot;
+	} else if ((dw = snapprim(v)) != NULL) {
+	    long j;
+
+	    /* A primitive is restored by name, so give its hidden
+	       copy, if any, the same name as it: the image is then
+	       the same whether it is saved from the words as they
+	       were compiled or as they were restored. */
+
+	    for (j = 0; j < nprims; j++) {
+		if (prims[j] == dw ||
+		    strcmp(prims[j]->wname + 1, dw->wname + 1) == 0)
+		    break;
+	    }
+	    if (j == nprims) {	      /* Allocate a name for a new primitive */
+		prims[nprims] = dw;
+		primoff[nprims++] = nnames;
+		nnames += strlen(dw->wname + 1) + 1;
+	    }
+	    tags[i] = SnapPrim;
+	    cells[i] = primoff[j];
+	}
+    }
+
+    /* Tag the fields of the words' dictionary items.  Every word
+       from the newest to older must lie in the image. */
+
+    for (dw = dict; dw != older; dw = dw->wnext) {
+	long c = ((stackitem *) dw) - hbase, k;
+
+	if (c < 0 || c + Dictwordl > ncells) {
+	    ncells = -1;
+	    break;
+	}
+
+	cells[c + DfCell(wname)] = 0;
+	tags[c + DfCell(wname)] = SnapRaw;
+	if (dw->wname != NULL) {
+	    tags[c + DfCell(wname)] = SnapName;
+	    cells[c + DfCell(wname)] = nnames;
+	    nnames += strlen(dw->wname + 1) + 2; /* Flags, name, and EOS */
+	}
+	for (k = 0; snapcode[k] != NULL; k++) {
+	    if (dw->wcode == snapcode[k])
+		break;
+	}
+	if (snapcode[k] == NULL) {    /* Unknown code: can't relocate */
+	    ncells = -1;
+	    break;
+	}
+	tags[c + DfCell(wcode)] = SnapCode;
+	cells[c + DfCell(wcode)] = k;
+#ifdef HASHDICT
+	tags[c + DfCell(whnext)] = SnapRaw;
+	cells[c + DfCell(whnext)] = 0; /* Rebuilt on restore */
+#endif
+    }
+
+    len = sizeof(struct snaphdr) + ncells * (sizeof(stackitem) + 1) + nnames;
+    if (ncells >= 0 && buf != NULL && buflen >= len) {
+	V memset((char *) &sh, 0, sizeof sh); /* Same padding every time */
+	sh.smagic = SnapMagic;
+	sh.sversion = SnapVersion;
+	sh.scell = sizeof(stackitem);
+	sh.sitem = sizeof(dictword);
+	sh.sheap = ((char *) heap) - ((char *) heapbot);
+	sh.sbase = ((char *) hbase) - ((char *) heapbot);
+	sh.scells = ncells;
+	sh.sdict = (dict == older) ? -1 :
+		   ((char *) dict) - ((char *) heapbot);
+	sh.snames = nnames;
+#ifdef TOKTHREAD
+	sh.sprims = snaptoks();
+#endif
+	memcpy(buf, (char *) &sh, sizeof sh);
+	buf += sizeof sh;
+	memcpy(buf, (char *) cells, ncells * sizeof(stackitem));
+	buf += ncells * sizeof(stackitem);
+	memcpy(buf, (char *) tags, ncells);
+	names = buf + ncells;
+	for (i = 0; i < nprims; i++)
+	    strcpy(names + primoff[i], prims[i]->wname + 1);
+	for (dw = dict; dw != older; dw = dw->wnext) {
+	    if (dw->wname != NULL) {
+		long c = ((stackitem *) dw) - hbase;
+
+		char *cp = names + cells[c + DfCell(wname)];
+
+		*cp = dw->wname[0];    /* The flags byte may be zero */
+		strcpy(cp + 1, dw->wname + 1);
+	    }
+	}
+    }
+    free((char *) primoff);
+    free((char *) prims);
+    free((char *) cells);
+    free((char *) tags);
+    return (ncells < 0) ? 0 : len;
+}
+
+/*  ATL_SNAPSAVE  --  Save the words defined since atl_init() in an
+		      image in buf, if its length, buflen, allows.
+		      Returns the length of the image, or zero if the
+		      dictionary can't be saved now. */
+
+long atl_snapsave(buf, buflen)
+  char *buf;
+  long buflen;
+{
+    return snapsave(heapprot, dictprot, buf, buflen);
+}
+
+/*  SNAPCHAIN  --  Check the chain of words in an image before it is
+		   restored.  Every link from sh->sdict must be to a
+		   whole, aligned item in the image, older than the one
+		   which links to it, with a name and a code field, and
+		   the oldest word must link to the word older, which
+		   the image's words are to follow.  The tags and names
+		   have been checked already.  Returns False if the
+		   image would leave the dictionary pointing anywhere
+		   else.  */
+
+static Boolean snapchain(sh, cells, tags, names, older)
+  struct snaphdr *sh;
+  stackitem *cells;
+  unsigned char *tags;
+  char *names;
+  dictword *older;
+{
+    long off = sh->sdict, lim;
+    stackitem v;
+
+    if (off < 0)		      /* The image defines no words */
+	return True;
+    lim = sh->sbase + sh->scells * (long) sizeof(stackitem);
+    while (off >= sh->sbase) {
+	long c;
+
+	if ((off % sizeof(stackitem)) != 0 ||
+	    off + (long) sizeof(dictword) > lim)
+	    return False;
+	c = (off - sh->sbase) / sizeof(stackitem);
+	if (tags[c + DfCell(wname)] != SnapName ||
+	    tags[c + DfCell(wcode)] != SnapCode)
+	    return False;
+	lim = off;		      /* The next word lies below this */
+	memcpy((char *) &v, (char *) &cells[c + DfCell(wnext)], sizeof v);
+	switch (tags[c + DfCell(wnext)]) {
+	    case SnapHeap:
+		off = v;
+		break;
+
+	    case SnapPrim:
+		V strcpy(tokbuf, names + v);
+		return (stackitem) lookup(tokbuf) == (stackitem) older;
+
+	    case SnapRaw:
+		return v == (stackitem) older;
+
+	    default:
+		return False;
+	}
+    }
+    return ((char *) heapbot) + off == (char *) older;
+}
+
+/*  SNAPRESTORE  --  Replace the heap from hbase up, and the words after
+		     older, with those saved in an image made from the
+		     same hbase by a system with the same heap layout.
+		     The image's words follow older, which must be in
+		     the dictionary below hbase.  Returns ATL_SNORM if the
+		     image was restored or ATL_BADSNAP if it can't be, in
+		     which case the dictionary is unchanged. */
+
+static int snaprestore(buf, len, hbase, older)
+  char *buf;
+  long len;
+  stackitem *hbase;
+  dictword *older;
+{
+    struct snaphdr sh;
+    unsigned char *tags;
+    stackitem *cells;
+    char *names;
+    long i, ncells;
+    dictword *odict;
+#ifdef HASHDICT
+    dictword **neww, *dw;
+    long nw = 0;
+#endif
+
+    if (heapprot == NULL || len < (long) sizeof sh)
+	return ATL_BADSNAP;
+    memcpy((char *) &sh, buf, sizeof sh);
+    if (sh.smagic != SnapMagic || sh.sversion != SnapVersion ||
+	sh.scell != sizeof(stackitem) || sh.sitem != sizeof(dictword) ||
+	sh.sheap != ((char *) heap) - ((char *) heapbot) ||
+	sh.sbase != ((char *) hbase) - ((char *) heapbot) ||
+	sh.scells < 0 ||
+#ifdef TOKTHREAD
+	sh.sprims != snaptoks() ||
+#endif
+	len != (long) (sizeof sh + sh.scells * (sizeof(stackitem) + 1) +
+		       sh.snames))
+	return ATL_BADSNAP;
+    cells = (stackitem *) (buf + sizeof sh);
+    tags = (unsigned char *) (buf + sizeof sh + sh.scells * sizeof(stackitem));
+    names = (char *) tags + sh.scells;
+    ncells = sh.scells; 	      /* Heap cells needed */
+
+    /* Make sure every primitive the image refers to is defined
+       and the image fits in the heap before we discard the current
+       dictionary. */
+
+    for (i = 0; i < sh.scells; i++) {
+	stackitem v;
+
+	memcpy((char *) &v, (char *) &cells[i], sizeof v);
+	switch (tags[i]) {
+	    case SnapRaw:
+		break;
+
+	    case SnapHeap:
+		if (v < 0 || v > ((char *) SnapTop) - ((char *) heapbot))
+		    return ATL_BADSNAP;
+		break;
+
+	    case SnapPrim:
+		if (v < 0 || v >= sh.snames ||
+		    memchr(names + v, EOS, (size_t) (sh.snames - v)) == NULL ||
+		    strlen(names + v) >= sizeof tokbuf)
+		    return ATL_BADSNAP;
+		V strcpy(tokbuf, names + v);
+		if (lookup(tokbuf) == NULL)
+		    return ATL_BADSNAP;
+		break;
+
+	    case SnapCode:
+		if (v < 0 || v >= (stackitem) (ELEMENTS(snapcode) - 1))
+		    return ATL_BADSNAP;
+		break;
+
+	    case SnapName:
+		if (v < 0 || v >= sh.snames - 1 ||
+		    memchr(names + v + 1, EOS, (size_t) (sh.snames - v - 1)) ==
+			NULL)
+		    return ATL_BADSNAP;
+#ifdef NAMEARENA
+		ncells += (strlen(names + v + 1) + 2 +
+			   (sizeof(stackitem) - 1)) / sizeof(stackitem);
+#endif
+		break;
+
+	    default:
+		return ATL_BADSNAP;
+	}
+    }
+#ifdef NAMEARENA
+    if (ncells > nametop(older) - hbase)
+#else
+    if (ncells > heaptop - hbase)
+#endif
+	return ATL_BADSNAP;
+    if (!snapchain(&sh, cells, tags, names, older))
+	return ATL_BADSNAP;
+
+#ifdef TASKS
+    taskkill(); 		      /* Tasks may be running user words */
+#endif
+    odict = dict;
+    dictcut(older);		      /* Forget the words after older */
+#ifdef NAMEARENA
+    heaptop = nametop(dict);	      /* Release their names */
+#endif
+    hptr = hbase;
+    heapcut(odict);
+
+    memcpy((char *) hbase, (char *) cells, sh.scells * sizeof(stackitem));
+    hptr = hbase + sh.scells;
+    for (i = 0; i < sh.scells; i++) {
+	stackitem *sp = hbase + i;
+
+	switch (tags[i]) {
+	    case SnapHeap:
+		*sp = (stackitem) (((char *) heapbot) + *sp);
+		break;
+
+	    case SnapPrim:
+		V strcpy(tokbuf, names + *sp);
+		*sp = (stackitem) lookup(tokbuf);
+		break;
+
+	    case SnapCode:
+		*((codeptr *) sp) = snapcode[*sp];
+		break;
+
+	    case SnapName:
+		{   char *np = names + *sp, *cp;
+
+#ifdef NAMEARENA
+		    cp = namealloc((unsigned int) (strlen(np + 1) + 2));
+#else
+		    cp = alloc((unsigned int) (strlen(np + 1) + 2));
+#endif
+
+		    *cp = *np;		      /* Copy flags byte */
+		    V strcpy(cp + 1, np + 1);
+		    *((char **) sp) = cp;
+		}
+		break;
+	}
+    }
+#ifdef MEMSTAT
+    if (hptr > heapmax)
+	heapmax = hptr;
+#endif
+#ifdef HASHDICT
+    if (older != dictprot && sh.sdict >= 0) {
+
+	/* Index the words added to the dictionary oldest first, as
+	   enter() would have, putting each at its head in turn so
+	   that a rebuild as the index grows sees just those indexed
+	   so far. */
+
+	for (dw = (dictword *) (((char *) heapbot) + sh.sdict); dw != older;
+	     dw = dw->wnext)
+	    nw++;
+	neww = (dictword **) alloc((unsigned int) (nw * sizeof(dictword *)));
+	for (dw = (dictword *) (((char *) heapbot) + sh.sdict), i = 0;
+	     dw != older; dw = dw->wnext)
+	    neww[i++] = dw;
+	while (--nw >= 0) {
+	    dict = neww[nw];
+	    dhinsert(dict);
+	}
+	free((char *) neww);
+	return ATL_SNORM;
     }
+#endif
+    if (sh.sdict >= 0)
+	dict = (dictword *) (((char *) heapbot) + sh.sdict);
+#ifdef HASHDICT
+    dhrebuild((dhlen == 0) ? Dhashlen : dhlen);
+#endif
+    return ATL_SNORM;
+}
+
+/*  ATL_SNAPRESTORE  --  Replace the words defined since atl_init()
+			 with those saved in an image.  The image must
+			 have been made by a system with the same
+			 heap layout.  Returns ATL_SNORM if the image
+			 was restored or ATL_BADSNAP if it can't be,
+			 in which case the dictionary is unchanged. */
+
+int atl_snaprestore(buf, len)
+  char *buf;
+  long len;
+{
+    return snaprestore(buf, len, heapprot, dictprot);
 }
+#endif /* SNAPSHOT */
 
 #ifdef BREAK
 
@@ -3459,32 +8166,267 @@ void atl_break()
 {
     broken = True;		      /* Set break request */
 }
+
+#ifdef MULTIVM
+
+/*  ATL_VMBREAK  --  Interrupt execution in a given instance, which
+		     needn't be the one selected by the caller.  */
+
+void atl_vmbreak(vm)
+  atl_vm *vm;
+{
+    vm->vm_broken = True;	      /* Set break request */
+}
+#endif /* MULTIVM */
 #endif /* BREAK */
 
-/*  ATL_LOAD  --  Load a file into the system.	*/
+#ifdef TASKS
+
+/*  ATL_TASKS  --  Give each background task a turn, as if the
+		   foreground had executed PAUSE.  Called by the
+		   application while it has nothing else for the
+		   interpreter to do.  Returns the number of background
+		   tasks still running.  */
+
+int atl_tasks()
+{
+    atl_task *t;
+    int n = 0;
+
+    if (fgtask != NULL && curtask == fgtask) {
+	if (fgtask->tnext != fgtask)
+	    V atl_exec((dictword *) s_pause);
+	for (t = fgtask->tnext; t != fgtask; t = t->tnext)
+	    n++;
+    }
+    return n;
+}
+
+/*  ATL_PAUSE  --  Called by a primitive running in a background task
+		   that has to wait for something.  Arranges for the
+		   primitive to be executed again when the task resumes,
+		   and passes control to the next task.  The primitive
+		   must return at once, leaving its arguments on the
+		   stack.  Returns False, leaving the primitive to wait
+		   as it would without tasks, if it isn't running in a
+		   background task at the task's own level or wasn't
+		   called from compiled code.  */
+
+int atl_pause()
+{
+    if (curtask == fgtask || evaldepth != taskdepth ||
+	ip == NULL || Tokword(ip[-1]) != curword)
+	return False;
+    ip--;			      /* Execute the primitive again */
+    curtask->tpaused = True;
+    tasksave(curtask);
+    taskload(curtask->tnext);
+    return True;
+}
+
+/*  ATL_RESUMED  --  Returns True, once, if the running task has
+		     resumed after atl_pause().  A primitive that
+		     pauses uses this to tell its first execution
+		     from the ones that follow.  */
+
+int atl_resumed()
+{
+    if (curtask != NULL && curtask->tpaused) {
+	curtask->tpaused = False;
+	return True;
+    }
+    return False;
+}
+#endif /* TASKS */
+
+#ifdef MULTIVM
+
+/*  ATL_VMSELECT  --  Select the instance on which the calling thread's
+		      ATLAST calls act, NULL selecting the default one.
+		      Returns the previously selected instance.  */
+
+atl_vm *atl_vmselect(vm)
+  atl_vm *vm;
+{
+    atl_vm *pvm = atl_vmp;
+
+    atl_vmp = (vm == NULL) ? &atl_vm0 : vm;
+    return pvm;
+}
+
+/*  ATL_VMNEW  --  Create and initialise a new interpreter instance,
+		   with stacks and heap of the lengths currently set in
+		   the atl_... cells.  The calling thread's selection is
+		   unchanged.  Returns NULL if memory is exhausted.  */
+
+atl_vm *atl_vmnew()
+{
+    atl_vm *vm = (atl_vm *) calloc(1, sizeof(atl_vm)), *pvm;
+
+    if (vm != NULL) {
+	vm->vm_flags.walkback = Truth;
+	vm->vm_flags.redef = Truth;
+	vm->vm_base = 10;
+	vm->vm_evalstat = ATL_SNORM;
+	pvm = atl_vmselect(vm);
+	atl_init();
+	V atl_vmselect(pvm);
+    }
+    return vm;
+}
+
+/*  ATL_VMFREE  --  Release an instance created by atl_vmnew() and all
+		    the storage atl_init() allocated for it.  It must
+		    not be selected by any thread.  */
+
+void atl_vmfree(vm)
+  atl_vm *vm;
+{
+    atl_vm *pvm = atl_vmselect(vm);
+
+#ifdef TASKS
+    taskkill();
+    free((char *) fgtask);
+#endif
+#ifndef NAMEARENA
+    {
+	dictword *dw;
+
+	/* Words defined in the heap have names of their own; those
+	   of primitive table items are released with their table. */
+
+	for (dw = dict; dw != NULL; dw = dw->wnext) {
+	    if (((stackitem *) dw) >= heap && ((stackitem *) dw) < heaptop)
+		free(dw->wname);
+	}
+    }
+#endif
+    while (primmem != NULL) {
+	char **pm = primmem;
+
+	primmem = (char **) *pm;
+	free((char *) pm);
+    }
+#ifdef HASHDICT
+    if (dhash != NULL)
+	free((char *) dhash);
+#endif
+#ifdef WBSTACK
+    free((char *) wback);
+#endif
+#ifdef PROFILE
+    if (profp != NULL)
+	free((char *) profp);
+#endif
+#ifdef MEMPOOL
+    if (pool != NULL)
+	free((char *) pool);
+#endif
+    free((char *) strbuf);
+    free((char *) heapbot);
+    free((char *) rstack);
+    free((char *) stack);
+    V atl_vmselect(pvm);
+    free((char *) vm);
+}
+
+/*  ATL_VMEVAL	--  Evaluate a string in a given instance.  */
+
+int atl_vmeval(vm, sp)
+  atl_vm *vm;
+  char *sp;
+{
+    atl_vm *pvm = atl_vmselect(vm);
+    int es = atl_eval(sp);
+
+    V atl_vmselect(pvm);
+    return es;
+}
+#endif /* MULTIVM */
+
+/*  ATL_LOAD  --  Load a file into the system.	The file is read a
+		  block at a time into one buffer, and each line is
+		  evaluated where it lies in the buffer.  Lines end as
+		  they do for atl_fgetsp().  A line longer than
+		  atl_linelen characters stops the load with status
+		  ATL_LINELONG rather than being cut short. */
+
+#define Loadblock   4096	      /* Bytes atl_load() reads at a time */
 
 int atl_load(fp)
   FILE *fp;
 {
     int es = ATL_SNORM;
-    char s[134];
+    char *buf, *lp, *cp, *bend;
+    unsigned int blen = (unsigned int) max(atl_linelen + 2, Loadblock);
+    Boolean eof = False;
     atl_statemark mk;
     atl_int scomm = atl_comment;      /* Stack comment pending state */
-    dictword **sip = ip;	      /* Stack instruction pointer */
+    atl_token *sip = ip;	      /* Stack instruction pointer */
     char *sinstr = instream;	      /* Stack input stream */
     int lineno = 0;		      /* Current line number */
+#ifdef CATCH
+    atl_catch *scatch = catchp;       /* A THROW may not pass our buffer */
+#endif
 
     atl_errline = 0;		      /* Reset line number of error */
+    if ((buf = malloc(blen + 1)) == NULL)
+	return ATL_HEAPOVER;
+#ifdef CATCH
+    catchp = NULL;
+#endif
+    lp = bend = buf;
     atl_mark(&mk);
     ip = NULL;			      /* Fool atl_eval into interp state */
-    while (atl_fgetsp(s, 132, fp) != NULL) {
+    while (True) {
+	char c;
+
+	/* Find the end of the next line.  If it, or the second
+	   character of a two character line end, may lie beyond the
+	   data in the buffer, move the data down and read more. */
+
+	for (cp = lp; cp < bend && *cp != '\n' && *cp != '\r'; cp++) ;
+	if (!eof && cp >= bend - 1 && (lp > buf || bend < buf + blen)) {
+	    size_t n;
+
+	    if (lp > buf) {
+		memmove(buf, lp, (size_t) (bend - lp));
+		bend -= lp - buf;
+		lp = buf;
+	    }
+	    if ((n = fread(bend, 1, (size_t) ((buf + blen) - bend), fp)) == 0)
+		eof = True;
+	    bend += n;
+	    continue;
+	}
+	if (lp >= bend) 	      /* End of file */
+	    break;
 	lineno++;
-	if ((es = atl_eval(s)) != ATL_SNORM) {
+	if (cp - lp > atl_linelen) {
+#ifdef MEMMESSAGE
+            V printf("\nLine %d too long.\n", lineno);
+#endif
+	    es = ATL_LINELONG;
+	    atl_errline = lineno;
+	    atl_unwind(&mk);
+	    break;
+	}
+	c = *cp;
+	*cp = EOS;		      /* Terminate the line in place */
+	if (cp < bend && ++cp < bend && ((c == '\r' && *cp == '\n') ||
+					  (c == '\n' && *cp == '\r')))
+	    cp++;
+	if ((es = atl_eval(lp)) != ATL_SNORM) {
 	    atl_errline = lineno;     /* Save line number of error */
 	    atl_unwind(&mk);
 	    break;
 	}
+	lp = cp;
     }
+    free(buf);
+#ifdef CATCH
+    catchp = scatch;
+#endif
     /* If there were no other errors, check for a runaway comment.  If
        we ended the file in comment-ignore mode, set the runaway comment
        error status and unwind the file.  */
@@ -3501,6 +8443,282 @@ int atl_load(fp)
     return es;
 }
 
+/*  Included files.  ATL_INCLUDE loads a file, named relative to the
+    directory atl_incdir, as atl_load() does, and then saves a snapshot
+    of what it added to the heap in a cache file beside it, named like
+    the source with a "c" appended: lib.fth is cached in lib.fthc.  The
+    cache records the length and a hash of the source and a hash of the
+    dictionary and heap before the file was loaded.  When the file is
+    next included into the same state and its source is unchanged, the
+    snapshot is restored in place of loading the source, and nothing is
+    tokenised or compiled.  Each cache holds only its own file's words,
+    so the caches together are about the size of the dictionary.
+
+    Restoring the snapshot repeats what loading the file did to the
+    heap above where it began, but nothing else: output it printed and
+    its effects on the hardware or the host program are not repeated,
+    nor are words defined before it marked as used by it.  A file which
+    changes the heap below, as by storing into a variable defined
+    before it, is not cached.  So included files should just define
+    words, leaving the rest to a file loaded the usual way, such as the
+    autoexec file.  A file which includes others is not cached itself,
+    since its cache could not tell when they change; they are cached in
+    its stead.  */
+
+#ifdef SNAPSHOT
+#define IncMagic    0x43535441L       /* Cache identifier: "ATSC" */
+#define Hashbasis   2166136261UL      /* FNV-1a hash offset basis */
+#define Hashprime   16777619UL	      /* FNV-1a hash prime */
+
+struct inchdr {
+    long imagic;		      /* IncMagic */
+    long ilen;			      /* Length of the source */
+    unsigned long isource;	      /* Hash of the source */
+    unsigned long istate;	      /* Hash of the state it was loaded into */
+    long iimage;		      /* Length of the snapshot which follows */
+    unsigned long ibody;	      /* Hash of the snapshot */
+};
+
+/*  INCHASH  --  Add n bytes to an FNV-1a hash.  */
+
+static unsigned long inchash(h, cp, n)
+  unsigned long h;
+  char *cp;
+  long n;
+{
+    while (n-- > 0)
+	h = ((h ^ (unsigned char) *cp++) * Hashprime) & 0xFFFFFFFFL;
+    return h;
+}
+
+/*  INCSTATE  --  Hash the user words and data below top: the state a
+		  file is included into.  Cells are hashed as a snapshot
+		  would save them, heap addresses as offsets, primitives
+		  and the names of words by their names, so the hash
+		  doesn't depend on where the heap and the program lie
+		  in memory.  The heap is walked from the top down, along
+		  with the chain of words, to pick out the fields of
+		  their items.  Returns zero if the state can't be
+		  cached.  */
+
+static unsigned long incstate(top)
+  stackitem *top;
+{
+    unsigned long h = Hashbasis;
+    dictword *dw = dict, *pw;
+    stackitem *sp, v;
+    long f, k;
+    char tag;
+
+    if (state || heapprot == NULL)
+	return 0;
+    for (sp = top - 1; sp >= heapprot; sp--) {
+	while (dw != dictprot && (stackitem *) dw > sp)
+	    dw = dw->wnext;
+	f = (dw != dictprot) ? sp - (stackitem *) dw : -1;
+	v = *sp;
+	tag = SnapRaw;
+	if (f == DfCell(wname)) {
+	    tag = SnapName;
+	    v = 0;
+	    if (dw->wname != NULL) {   /* Flags but whether used, and name */
+		v = dw->wname[0] & ~WORDUSED;
+		h = inchash(h, dw->wname + 1, (long) strlen(dw->wname + 1));
+	    }
+	} else if (f == DfCell(wcode)) {
+	    for (k = 0; snapcode[k] != NULL && dw->wcode != snapcode[k]; k++) ;
+	    if (snapcode[k] == NULL)
+		return 0;		      /* Can't be saved */
+	    tag = SnapCode;
+	    v = k;
+#ifdef HASHDICT
+	} else if (f == DfCell(whnext)) {
+	    v = 0;			      /* Varies with the index */
+#endif
+	} else if (v >= (stackitem) heapbot && v < (stackitem) SnapTop) {
+	    tag = SnapHeap;
+	    v -= (stackitem) heapbot;
+	} else if ((pw = snapprim(v)) != NULL) {
+	    tag = SnapPrim;
+	    h = inchash(h, pw->wname + 1, (long) strlen(pw->wname + 1));
+	    v = 0;
+	}
+	h = inchash(h, &tag, 1L);
+	h = inchash(h, (char *) &v, (long) sizeof v);
+    }
+    return (h == 0) ? 1 : h;
+}
+#endif /* SNAPSHOT */
+
+/*  INCPATH  --  Make the path of a file, named relative to
+		 atl_incdir, with a suffix appended to its name.  The
+		 caller frees it.  Returns NULL if out of memory.  */
+
+static char *incpath(name, suffix)
+  char *name, *suffix;
+{
+    char *path;
+
+    path = malloc((atl_incdir == NULL ? 0 : strlen(atl_incdir)) +
+		  strlen(name) + strlen(suffix) + 2);
+    if (path == NULL)
+	return NULL;
+    path[0] = EOS;
+    if (atl_incdir != NULL && name[0] != '/') {
+	V strcpy(path, atl_incdir);
+	V strcat(path, "/");
+    }
+    V strcat(path, name);
+    V strcat(path, suffix);
+    return path;
+}
+
+/*  INCOPEN  --  Open a file named as incpath() does.  */
+
+static FILE *incopen(name, suffix, mode)
+  char *name, *suffix, *mode;
+{
+    char *path = incpath(name, suffix);
+    FILE *fp;
+
+    if (path == NULL)
+	return NULL;
+    fp = fopen(path, mode);
+    free(path);
+    return fp;
+}
+
+#ifdef SNAPSHOT
+
+/*  INCREMOVE  --  Delete a file named as incpath() does.  */
+
+static void incremove(name, suffix)
+  char *name, *suffix;
+{
+    char *path = incpath(name, suffix);
+
+    if (path != NULL) {
+	V remove(path);
+	free(path);
+    }
+}
+#endif /* SNAPSHOT */
+
+/*  ATL_INCLUDE  --  Include a file, from its cache if that is up to
+		     date.  Returns the status of loading it, or
+		     ATL_NOFILE if it cannot be opened.  */
+
+int atl_include(name)
+  char *name;
+{
+    FILE *fp;
+    int es;
+#ifdef SNAPSHOT
+    FILE *cp;
+    struct inchdr ih, ch;
+    char *buf;
+    long n, nest;
+    Boolean damaged = False;	      /* Cache matched but unusable */
+    stackitem *hbase = hptr;	      /* Heap and words before the file */
+    dictword *older = dict;
+
+    if ((fp = incopen(name, "", "rb")) == NULL)
+	return ATL_NOFILE;
+    nest = ++incount;		      /* Note if this file includes others */
+    if ((buf = malloc(Loadblock)) == NULL) {
+	fclose(fp);
+	return ATL_HEAPOVER;
+    }
+    ih.imagic = IncMagic;
+    ih.ilen = 0;
+    ih.isource = Hashbasis;
+    while ((n = (long) fread(buf, 1, Loadblock, fp)) > 0) {
+	ih.isource = inchash(ih.isource, buf, n);
+	ih.ilen += n;
+    }
+    free(buf);
+    ih.istate = incstate(hbase);
+    rewind(fp);
+
+    /* Restore the file's snapshot if its cache matches.  Not while
+       compiling or while tasks may be running words it replaces.  A
+       cache whose snapshot doesn't match its hash has been damaged,
+       and is deleted so the file is loaded from its source and the
+       cache written afresh. */
+
+    if (ih.istate != 0 && !state &&
+#ifdef TASKS
+	(fgtask == NULL || fgtask->tnext == fgtask) &&
+#endif
+	(cp = incopen(name, "c", "rb")) != NULL) {
+	es = ATL_BADSNAP;
+	if (fread((char *) &ch, sizeof ch, 1, cp) == 1 &&
+	    ch.imagic == ih.imagic && ch.ilen == ih.ilen &&
+	    ch.isource == ih.isource && ch.istate == ih.istate &&
+	    ch.iimage > 0 && (buf = malloc((size_t) ch.iimage)) != NULL) {
+	    if (fread(buf, 1, (size_t) ch.iimage, cp) == (size_t) ch.iimage &&
+		inchash(Hashbasis, buf, ch.iimage) == ch.ibody)
+		es = snaprestore(buf, ch.iimage, hbase, older);
+	    damaged = (es != ATL_SNORM);
+	    free(buf);
+	}
+	fclose(cp);
+	if (damaged)
+	    incremove(name, "c");
+	if (es == ATL_SNORM) {
+	    fclose(fp);
+	    return es;
+	}
+    }
+
+    es = atl_load(fp);
+    fclose(fp);
+
+    /* Save a snapshot of what the file added to the heap as its
+       cache, unless it changed anything below: its cache could not
+       repeat that.  One cut short by a full filesystem won't be
+       read, as its image is shorter than its header says. */
+
+    if (es == ATL_SNORM && incount == nest && ih.istate != 0 &&
+	hptr >= hbase && incstate(hbase) == ih.istate &&
+	(ih.iimage = snapsave(hbase, older, NULL, 0)) > 0 &&
+	(buf = malloc((size_t) ih.iimage)) != NULL) {
+	V snapsave(hbase, older, buf, ih.iimage);
+	ih.ibody = inchash(Hashbasis, buf, ih.iimage);
+	if ((cp = incopen(name, "c", "wb")) != NULL) {
+	    if (fwrite((char *) &ih, sizeof ih, 1, cp) == 1)
+		V fwrite(buf, 1, (size_t) ih.iimage, cp);
+	    fclose(cp);
+	}
+	free(buf);
+    }
+#else /* !SNAPSHOT */
+    if ((fp = incopen(name, "", "rb")) == NULL)
+	return ATL_NOFILE;
+    es = atl_load(fp);
+    fclose(fp);
+#endif /* SNAPSHOT */
+    return es;
+}
+
+/*  ATL_AUTOEXEC  --  Load the file autoexec.fth from atl_incdir, if
+		      there is one.  It is loaded from its source every
+		      time, so it can start jobs and set up hardware as
+		      well as including the files which define words.
+		      Returns ATL_SNORM if there is no such file.  */
+
+int atl_autoexec()
+{
+    FILE *fp;
+    int es;
+
+    if ((fp = incopen("autoexec.fth", "", "rb")) == NULL)
+	return ATL_SNORM;
+    es = atl_load(fp);
+    fclose(fp);
+    return es;
+}
+
 /*  ATL_PROLOGUE  --  Recognise and process prologue statement.
 		      Returns 1 if the statement was part of the
 		      prologue and 0 otherwise. */
@@ -3518,6 +8736,7 @@ int atl_prologue(sp)
         {"STACK ", &atl_stklen},
         {"RSTACK ", &atl_rstklen},
         {"HEAP ", &atl_heaplen},
+        {"POOL ", &atl_poollen},
         {"TEMPSTRL ", &atl_ltempstr},
         {"TEMPSTRN ", &atl_ntempstr}
     };
@@ -3545,8 +8764,25 @@ V printf("Prologue set %sto %ld\n", proname[i].pname, *proname[i].pparam);
 
 /*  ATL_EVAL  --  Evaluate a string containing ATLAST words.  */
 
+#ifdef TASKS
+static int evalstring();
+
 int atl_eval(sp)
   char *sp;
+{
+    int es;
+
+    evaldepth++;		      /* Tasks switch only at their own level */
+    es = evalstring(sp);
+    evaldepth--;
+    return es;
+}
+
+static int evalstring(sp)
+#else
+int atl_eval(sp)
+#endif
+  char *sp;
 {
     int i;
 
@@ -3580,40 +8816,32 @@ int atl_eval(sp)
 		    forgetpend = False;
 		    ucase(tokbuf);
 		    if ((di = lookup(tokbuf)) != NULL) {
-			dictword *dw = dict;
 
-			/* Pass 1.  Rip through the dictionary to make sure
-				    this word is not past the marker that
-				    guards against forgetting too much. */
+			/* Words in the heap are ordered by address, so
+			   userword() tells at once whether this one lies
+			   past the marker that guards against forgetting
+			   too much, or is a primitive. */
 
-			while (dw != NULL) {
-			    if (dw == dictprot) {
+			if (!userword(di)) {
 #ifdef MEMMESSAGE
-                                V printf("\nForget protected.\n");
+                            V printf("\nForget protected.\n");
 #endif
-				evalstat = ATL_FORGETPROT;
-				di = NULL;
-			    }
-			    if (strcmp(dw->wname + 1, tokbuf) == 0)
-				break;
-			    dw = dw->wnext;
+			    evalstat = ATL_FORGETPROT;
+			    di = NULL;
 			}
 
-			/* Pass 2.  Walk back through the dictionary
-				    items until we encounter the target
-                                    of the FORGET.  Release each item's
-				    name buffer and dechain it from the
-				    dictionary list. */
+			/* Cut the dictionary back to the word before the
+			   target of the FORGET, releasing the names of
+			   the items dropped, and back the heap allocation
+			   pointer up to the start of the target. */
 
 			if (di != NULL) {
-			    do {
-				dw = dict;
-				if (dw->wname != NULL)
-				    free(dw->wname);
-				dict = dw->wnext;
-			    } while (dw != di);
-			    /* Finally, back the heap allocation pointer
-			       up to the start of the last item forgotten. */
+			    dictword *odict = dict;
+
+			    dictcut(di->wnext);
+#ifdef NAMEARENA
+			    heaptop = nametop(dict); /* Release names */
+#endif
 			    hptr = (stackitem *) di;
 			    /* Uhhhh, just one more thing.  If this word
                                was defined with DOES>, there's a link to
@@ -3627,6 +8855,7 @@ V printf(" Forgetting DOES> word. ");
 #endif
 				hptr--;
 			    }
+			    heapcut(odict);
 			}
 		    } else {
 #ifdef MEMMESSAGE
@@ -3671,13 +8900,14 @@ V printf(" Forgetting DOES> word. ");
 				/* If a compile-time tick preceded this
 				   word, compile a (lit) word to cause its
 				   address to be pushed at execution time. */
+				Compword(s_lit);
 				Ho(1);
-				Hstore = s_lit;
+				Hstore = (stackitem) di;
 				ctickpend = False;
+			    } else {
+				Compword(di); /* Compile word address */
 			    }
 			    cbrackpend = False;
-			    Ho(1);	  /* Reserve stack space */
-			    Hstore = (stackitem) di;/* Compile word address */
 			} else {
 			    exword(di);   /* Execute word */
 			}
@@ -3693,9 +8923,7 @@ V printf(" Forgetting DOES> word. ");
 
 	    case TokInt:
 		if (state) {
-		    Ho(2);
-		    Hstore = s_lit;   /* Push (lit) */
-		    Hstore = tokint;  /* Compile actual literal */
+		    Complit(tokint);  /* Compile actual literal */
 		} else {
 		    So(1);
 		    Push = tokint;
@@ -3711,11 +8939,17 @@ V printf(" Forgetting DOES> word. ");
 			stackitem s[Realsize];
 		    } tru;
 
-		    Ho(Realsize + 1);
-		    Hstore = s_flit;  /* Push (flit) */
+		    tru.s[Realsize - 1] = 0;
     	    	    tru.r = tokreal;
-		    for (i = 0; i < Realsize; i++) {
-			Hstore = tru.s[i];
+		    if (Realsize == 1) {
+			/* A real that fits in a cell is just a literal */
+			Complit(tru.s[0]);
+		    } else {
+			Compword(s_flit); /* Push (flit) */
+			Ho(Realsize);
+			for (i = 0; i < Realsize; i++) {
+			    Hstore = tru.s[i];
+			}
 		    }
 		} else {
 		    int i;
@@ -3725,6 +8959,7 @@ V printf(" Forgetting DOES> word. ");
 		    } tru;
 
 		    So(Realsize);
+		    tru.s[Realsize - 1] = 0;
     	    	    tru.r = tokreal;
 		    for (i = 0; i < Realsize; i++) {
 			Push = tru.s[i];
@@ -3741,7 +8976,8 @@ V printf(" Forgetting DOES> word. ");
 			int l = (strlen(tokbuf) + 1 + sizeof(stackitem)) /
 				    sizeof(stackitem);
 			Ho(l);
-			*((char *) hptr) = l;  /* Store in-line skip length */
+			*((char *) hptr) = l * Tokcell; /* Store in-line skip
+							   length */
 			V strcpy(((char *) hptr) + 1, tokbuf);
 			hptr += l;
 		    } else {
@@ -3751,11 +8987,12 @@ V printf(" Forgetting DOES> word. ");
 		    if (state) {
 			int l = (strlen(tokbuf) + 1 + sizeof(stackitem)) /
 				    sizeof(stackitem);
-			Ho(l + 1);
 			/* Compile string literal instruction, followed by
 			   in-line skip length and the string literal */
-			Hstore = s_strlit;
-			*((char *) hptr) = l;  /* Store in-line skip length */
+			Compword(s_strlit);
+			Ho(l);
+			*((char *) hptr) = l * Tokcell; /* Store in-line skip
+							   length */
 			V strcpy(((char *) hptr) + 1, tokbuf);
 			hptr += l;
 		    } else {
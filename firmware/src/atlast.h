@@ -17,8 +17,28 @@
 
 */
 
+#ifndef ATLAST_H
+#define ATLAST_H
+
 typedef long atl_int;		      /* Stack integer type */
+
+/*  Real numbers are double precision unless REALFLOAT selects single
+    precision or REALFIXED selects fixed point with 16 fraction bits
+    (Q16.16 on a 32-bit target); either of those fits in one stack
+    cell and avoids double precision arithmetic, which is done in
+    software on processors without a double precision FPU.  The
+    choice must be the same for every file that includes this one,
+    so set it on the compiler command line, not in atlcfig.h.  */
+
+#ifdef REALFIXED
+typedef long atl_real;		      /* Real number type: fixed point */
+#else
+#ifdef REALFLOAT
+typedef float atl_real; 	      /* Real number type: single */
+#else
 typedef double atl_real;	      /* Real number type */
+#endif
+#endif
 
 /*  External symbols accessible by the calling program.  */
 
@@ -27,7 +47,37 @@ extern atl_int atl_rstklen;	      /* Initial/current return stack length */
 extern atl_int atl_heaplen;	      /* Initial/current heap length */
 extern atl_int atl_ltempstr;	      /* Temporary string buffer length */
 extern atl_int atl_ntempstr;	      /* Number of temporary string buffers */
+extern atl_int atl_linelen;	      /* Longest line atl_load() accepts */
+extern atl_int atl_poollen;	      /* ALLOCATE pool length in bytes */
+extern char *atl_incdir;	      /* Directory of files to include */
+
+#ifdef MULTIVM
+
+/*  With MULTIVM, every interpreter instance has its own stacks, heap,
+    dictionary and evaluator state, held in an atl_vm.	The entry points
+    act on the instance selected for the calling thread, so one thread
+    runs one instance at a time and several threads can run separate
+    instances concurrently.  An atl_vm begins with the mode flags below,
+    which lets calling programs reach them without ATLDEF.H. */
 
+typedef struct atl_vm atl_vm;	      /* Interpreter instance */
+
+typedef struct {
+    atl_int trace;		      /* Trace mode */
+    atl_int walkback;		      /* Error walkback enabled mode */
+    atl_int comment;		      /* Currently ignoring comment */
+    atl_int redef;		      /* Allow redefinition without warning */
+    atl_int errline;		      /* Line where last atl_load() failed */
+} atl_vmflags;
+
+extern __thread atl_vm *atl_vmp;      /* Instance selected for this thread */
+
+#define atl_trace    (((atl_vmflags *) atl_vmp)->trace)
+#define atl_walkback (((atl_vmflags *) atl_vmp)->walkback)
+#define atl_comment  (((atl_vmflags *) atl_vmp)->comment)
+#define atl_redef    (((atl_vmflags *) atl_vmp)->redef)
+#define atl_errline  (((atl_vmflags *) atl_vmp)->errline)
+#else
 extern atl_int atl_trace;	      /* Trace mode */
 extern atl_int atl_walkback;	      /* Error walkback enabled mode */
 extern atl_int atl_comment;	      /* Currently ignoring comment */
@@ -35,6 +85,7 @@ extern atl_int atl_redef;	      /* Allow redefinition of words without
                                          issuing the "not unique" warning. */
 extern atl_int atl_errline;	      /* Line number where last atl_load()
 					 errored or zero if no error. */
+#endif /* MULTIVM */
 
 /*  ATL_EVAL return status codes  */
 
@@ -53,9 +104,25 @@ extern atl_int atl_errline;	      /* Line number where last atl_load()
 #define ATL_BREAK	-12	      /* Asynchronous break signal received */
 #define ATL_DIVZERO	-13	      /* Attempt to divide by zero */
 #define ATL_APPLICATION -14	      /* Application primitive atl_error() */
+#define ATL_BADSNAP	-15	      /* Snapshot image unusable */
+#define ATL_LINELONG	-16	      /* Source line longer than atl_linelen */
+#define ATL_NOFILE	-17	      /* File to include not found */
+#define ATL_THROW	-18	      /* THROW with no CATCH to take it */
 
 /*  Entry points  */
 
 extern void atl_init(), atl_mark(), atl_unwind(), atl_break();
 extern int atl_eval(char *sp), atl_load();
+extern int atl_include(char *name), atl_autoexec(void);
 extern void atl_memstat();
+extern unsigned long atl_profwords(void);
+extern long atl_snapsave(char *buf, long buflen);
+extern int atl_snaprestore(char *buf, long len);
+extern int atl_tasks(void), atl_pause(void), atl_resumed(void);
+#ifdef MULTIVM
+extern atl_vm *atl_vmnew(void), *atl_vmselect(atl_vm *vm);
+extern void atl_vmfree(atl_vm *vm), atl_vmbreak(atl_vm *vm);
+extern int atl_vmeval(atl_vm *vm, char *sp);
+#endif
+
+#endif /* ATLAST_H */
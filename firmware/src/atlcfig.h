@@ -1,7 +1,29 @@
-#define MEMSTAT
+#define MEMSTAT			      /* 统计内存使用：MEMSTAT 打印各区用量 */
+#define DIRECTTHREAD		      /* 直接线索解释器：按代码地址跳转 */
+#ifndef NONAMEARENA		      /* 编译时加 -DNONAMEARENA 则逐个 malloc */
+#define NAMEARENA		      /* 字名从 Forth 堆分配，不占 C 堆 */
+#endif
+#define RSWALKBACK		      /* 出错时从返回栈重建调用回溯，调用时不再记录 */
+/* #define PROFILE */		      /* 逐字计数与计时：PROFILE .PROFILE */
+
+// TOKTHREAD（16 位令牌，代码减半但较慢）会改变 atldef.h 中的类型，
+// main.cpp 不包含本文件，所以不能在这里定义，须加到 platformio.ini
+// 的 build_flags 中
 
 // 提供键盘交互能力
 extern int Keyhit_impl();
 
 #define Keyhit Keyhit_impl
-#define Keybreak() { int ch = Keyhit(); broken = (ch == 27) || (ch == 'q') || (ch == 'Q'); }
+
+// 不定义 Keybreak：中断由串口接收回调异步调用 atl_break() 触发，
+// exword() 每个字只检查一次 broken 标志
+
+// 性能分析计时：CPU 周期计数（仅在定义 PROFILE 时使用）
+extern unsigned long Profclock_impl();
+
+#define Profclock Profclock_impl
+
+// 字被 FORGET、标记回滚或快照恢复删除后调用，应用据此丢弃所持有的字
+extern void Forgotten_impl();
+
+#define Forgotten Forgotten_impl
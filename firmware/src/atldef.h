@@ -25,11 +25,22 @@ typedef void (*codeptr)();	      /* Machine code pointer */
 /*  Dictionary word entry  */
 
 typedef struct dw {
+#ifndef ROMDICT
     struct dw *wnext;		      /* Next word in dictionary */
+#endif
     char *wname;		      /* Word name.  The first character is
 					 actually the word flags, including
 					 the (IMMEDIATE) bit. */
     codeptr wcode;		      /* Machine code implementation */
+#ifdef ROMDICT
+    struct dw *wnext;		      /* Next word in dictionary.  Placed
+					 after the name and code so that
+					 a primfcn table entry has the
+					 layout of a dictionary item. */
+#endif
+#ifdef HASHDICT
+    struct dw *whnext;		      /* Next word in hash bucket chain */
+#endif
 } dictword;
 
 /*  Word flag bits  */
@@ -41,7 +52,25 @@ typedef struct dw {
 /*  Data types	*/
 
 typedef long stackitem;
-typedef dictword **rstackitem;
+
+/*  Compiled code is a sequence of tokens, each a reference to a word
+    or an in-line operand.  Normally a token is the address of the
+    word's dictionary item.  With TOKTHREAD it is 16 bits: words in
+    the heap are numbered by their cell offset from the start of the
+    heap, primitives from Tokprim up in the order their tables were
+    defined.  Branch offsets and short literals occupy one token;
+    longer in-line data start at the next cell boundary.  Since this
+    changes the types every file that includes this one sees, set
+    TOKTHREAD on the compiler command line, not in atlcfig.h. */
+
+#ifdef TOKTHREAD
+typedef unsigned short atl_token;
+#define Tokprim     0xF000	      /* First primitive token */
+#else
+typedef dictword *atl_token;
+#endif
+#define Toksegs     8		      /* Maximum number of primitive tables */
+typedef atl_token *rstackitem;
 
 /* Stack items occupied by a dictionary word definition */
 #define Dictwordl ((sizeof(dictword)+(sizeof(stackitem)-1))/sizeof(stackitem))
@@ -62,6 +91,12 @@ struct primfcn {
 #endif
     char *pname;
     codeptr pcode;
+#ifdef ROMDICT
+    struct dw *pnext;		      /* Unused: pad entry to dictword */
+#ifdef HASHDICT
+    struct dw *phnext;
+#endif
+#endif
 };
 
 /*  Internal state marker item	*/
@@ -69,12 +104,111 @@ struct primfcn {
 typedef struct {
     stackitem *mstack;		      /* Stack position marker */
     stackitem *mheap;		      /* Heap allocation marker */
-    dictword ***mrstack;	      /* Return stack position marker */
+    rstackitem *mrstack;	      /* Return stack position marker */
     dictword *mdict;		      /* Dictionary marker */
 } atl_statemark;
 
+#ifdef MULTIVM
+
+/*  Interpreter instance.  Every variable that describes the state of
+    one interpreter lives here; the names used throughout ATLAST are
+    macros that reach the field in the instance selected for the
+    calling thread.  The fields after the exported ones are private to
+    ATLAST.C but are declared unconditionally, so the layout doesn't
+    depend on which subpackages were configured.  */
+
+struct atl_vm {
+    atl_vmflags vm_flags;	      /* Mode flags (must be first) */
+
+    stackitem *vm_stack, *vm_stk, *vm_stackbot, *vm_stacktop;
+    rstackitem *vm_rstack, *vm_rstk, *vm_rstackbot, *vm_rstacktop;
+    stackitem *vm_heap, *vm_hptr, *vm_heapbot, *vm_heaptop;
+    dictword *vm_dict, *vm_dictprot;
+    char **vm_strbuf;
+    int vm_cstrbuf;
+    atl_token *vm_ip;
+    dictword *vm_curword, *vm_createword;
+    stackitem *vm_stackmax, *vm_heapmax;
+    rstackitem *vm_rstackmax;
+    atl_real vm_rbuf0, vm_rbuf1, vm_rbuf2;
+
+    /* Private to ATLAST.C */
+
+    stackitem *vm_heapprot, *vm_heapend;
+    dictword **vm_dhash;
+    unsigned int vm_dhlen, vm_dhcount;
+    dictword **vm_wback, **vm_wbptr;
+    char vm_tokbuf[128];
+    char *vm_instream;
+    long vm_tokint;
+    atl_real vm_tokreal;
+    long vm_base;
+    int vm_evalstat;
+    int vm_defpend, vm_forgetpend, vm_tickpend, vm_ctickpend,
+	vm_cbrackpend, vm_stringlit;
+    volatile int vm_broken;
+    stackitem vm_s_exit, vm_s_lit, vm_s_flit, vm_s_strlit, vm_s_dotparen,
+	      vm_s_qbranch, vm_s_branch, vm_s_xdo, vm_s_xqdo, vm_s_xloop,
+	      vm_s_pxloop, vm_s_abortq;
+    dictword *vm_primbase;
+    char **vm_primmem;
+    stackitem vm_s_pause;
+    struct atl_task *vm_fgtask, *vm_curtask;
+    stackitem vm_taskseq;
+    int vm_evaldepth, vm_taskdepth;
+    stackitem vm_s_slit;
+    dictword *vm_tokbase[Toksegs];
+    int vm_toklen[Toksegs], vm_ntokseg;
+    atl_token *vm_tokfree;
+    stackitem *vm_tokhptr;
+    stackitem vm_s_litplus, vm_s_litat, vm_s_litbang, vm_s_iplus,
+	      vm_s_dupqbranch, vm_s_zqbranch, vm_s_2dup, vm_s_tail;
+    dictword *vm_peepw[4];
+    atl_token *vm_peepat[4];
+    int vm_npeep;
+    struct atl_prof *vm_profp;
+    int vm_profon;
+    long vm_incount;
+    struct atl_pool *vm_pool;
+    struct atl_wblevel *vm_wblevel;
+    struct atl_catch *vm_catchp;
+};
+
+#define stack	    (atl_vmp->vm_stack)
+#define stk	    (atl_vmp->vm_stk)
+#define stackbot    (atl_vmp->vm_stackbot)
+#define stacktop    (atl_vmp->vm_stacktop)
+#define rstack	    (atl_vmp->vm_rstack)
+#define rstk	    (atl_vmp->vm_rstk)
+#define rstackbot   (atl_vmp->vm_rstackbot)
+#define rstacktop   (atl_vmp->vm_rstacktop)
+#define heap	    (atl_vmp->vm_heap)
+#define hptr	    (atl_vmp->vm_hptr)
+#define heapbot     (atl_vmp->vm_heapbot)
+#define heaptop     (atl_vmp->vm_heaptop)
+#define dict	    (atl_vmp->vm_dict)
+#define dictprot    (atl_vmp->vm_dictprot)
+#define strbuf	    (atl_vmp->vm_strbuf)
+#define cstrbuf     (atl_vmp->vm_cstrbuf)
+#define ip	    (atl_vmp->vm_ip)
+#define curword     (atl_vmp->vm_curword)
+#define createword  (atl_vmp->vm_createword)
+#define stackmax    (atl_vmp->vm_stackmax)
+#define rstackmax   (atl_vmp->vm_rstackmax)
+#define heapmax     (atl_vmp->vm_heapmax)
+#define rbuf0	    (atl_vmp->vm_rbuf0)
+#define rbuf1	    (atl_vmp->vm_rbuf1)
+#define rbuf2	    (atl_vmp->vm_rbuf2)
+#endif /* MULTIVM */
+
 #ifdef EXPORT
 #define Exported
+#define FmodeR	    1		      /* Read mode */
+#define FmodeW	    2		      /* Write mode */
+#define FmodeB	    4		      /* Binary file mode */
+#define FmodeCre    8		      /* Create new file */
+
+#ifndef MULTIVM
 #ifndef NOMANGLE
 #define stk	    atl__sp
 #define stack	    atl__sk
@@ -104,7 +238,7 @@ typedef struct {
 #define heapmax     atl__hx
 #endif /* NOMANGLE */
 extern stackitem *stackmax, *heapmax;
-extern dictword ***rstackmax;
+extern rstackitem *rstackmax;
 #endif
 
 #ifdef ALIGNMENT
@@ -116,18 +250,14 @@ extern dictword ***rstackmax;
 extern atl_real rbuf0, rbuf1, rbuf2;  /* Real temporaries for alignment */
 #endif
 
-#define FmodeR	    1		      /* Read mode */
-#define FmodeW	    2		      /* Write mode */
-#define FmodeB	    4		      /* Binary file mode */
-#define FmodeCre    8		      /* Create new file */
-
 extern stackitem *stack, *stk, *stackbot, *stacktop, *heap, *hptr,
 		 *heapbot, *heaptop;
-extern dictword ***rstack, ***rstk, ***rstackbot, ***rstacktop;
+extern rstackitem *rstack, *rstk, *rstackbot, *rstacktop;
 extern dictword *dict, *dictprot, *curword, *createword;
-extern dictword **ip;
+extern atl_token *ip;
 extern char **strbuf;
 extern int cstrbuf;
+#endif /* !MULTIVM */
 
 #ifndef NOMANGLE
 #define P_create    atl__Pcr
@@ -155,10 +285,10 @@ void stakover(), rstakover(), heapover(), badpointer(),
 #endif
 
 /* Functions called by exported extensions. */
-extern void atl_primdef(struct primfcn *pt), atl_error();
+extern void atl_primdef(const struct primfcn *pt), atl_error();
 extern dictword *atl_lookup(), *atl_vardef();
 extern stackitem *atl_body();
-extern int atl_exec();
+extern int atl_exec(dictword *dw), atl_defined(dictword *dw);
 #ifdef EXPORT
 extern char *atl_fgetsp();
 #endif
@@ -270,22 +400,47 @@ pragma On(PCC_msgs);		      /* High C compiler is brain-dead */
 
 /*  Real number definitions (used only if REAL is configured).	*/
 
-#define Realsize (sizeof(atl_real)/sizeof(stackitem)) /* Stack cells / real */
+#define Realsize ((sizeof(atl_real) + sizeof(stackitem) - 1) / \
+		  sizeof(stackitem))  /* Stack cells / real */
 #define Realpop  stk -= Realsize      /* Pop real from stack */
 #define Realpop2 stk -= (2 * Realsize) /* Pop two reals from stack */
+#define Realp(n) (stk - ((n) + 1) * Realsize) /* Address of nth real */
 
 #ifdef ALIGNMENT
-#define REAL0 *((atl_real *) memcpy((char *) &rbuf0, (char *) &S1, sizeof(atl_real)))
-#define REAL1 *((atl_real *) memcpy((char *) &rbuf1, (char *) &S3, sizeof(atl_real)))
-#define REAL2 *((atl_real *) memcpy((char *) &rbuf2, (char *) &S5, sizeof(atl_real)))
-#define SREAL0(x) rbuf2=(x); (void)memcpy((char *) &S1, (char *) &rbuf2, sizeof(atl_real))
-#define SREAL1(x) rbuf2=(x); (void)memcpy((char *) &S3, (char *) &rbuf2, sizeof(atl_real))
+#define REAL0 *((atl_real *) memcpy((char *) &rbuf0, (char *) Realp(0), sizeof(atl_real)))
+#define REAL1 *((atl_real *) memcpy((char *) &rbuf1, (char *) Realp(1), sizeof(atl_real)))
+#define REAL2 *((atl_real *) memcpy((char *) &rbuf2, (char *) Realp(2), sizeof(atl_real)))
+#define SREAL0(x) rbuf2=(x); (void)memcpy((char *) Realp(0), (char *) &rbuf2, sizeof(atl_real))
+#define SREAL1(x) rbuf2=(x); (void)memcpy((char *) Realp(1), (char *) &rbuf2, sizeof(atl_real))
+#else
+#define REAL0	*((atl_real *) Realp(0)) /* First real on stack */
+#define REAL1	*((atl_real *) Realp(1)) /* Second real on stack */
+#define REAL2	*((atl_real *) Realp(2)) /* Third real on stack */
+#define SREAL0(x) *((atl_real *) Realp(0)) = (x)
+#define SREAL1(x) *((atl_real *) Realp(1)) = (x)
+#endif
+
+/*  Real arithmetic which differs between representations.  Rmul and
+    Rdiv multiply and divide, Itor and Rtoi convert from and to an
+    integer (truncating toward zero), and Dtor and Rtod convert from
+    and to a double.  */
+
+#ifdef REALFIXED
+#define Rfrac	 16		      /* Fraction bits */
+#define Rone	 (1L << Rfrac)	      /* 1.0 */
+#define Rmul(a, b) ((atl_real) (((long long) (a) * (b)) >> Rfrac))
+#define Rdiv(a, b) ((atl_real) (((long long) (a) * Rone) / (b)))
+#define Itor(i)  ((atl_real) (i) * Rone)
+#define Rtoi(r)  ((stackitem) ((r) / Rone))
+#define Dtor(d)  ((atl_real) ((d) < 0 ? (d) * Rone - 0.5 : (d) * Rone + 0.5))
+#define Rtod(r)  ((double) (r) / Rone)
 #else
-#define REAL0	*((atl_real *) &S1)   /* First real on stack */
-#define REAL1	*((atl_real *) &S3)   /* Second real on stack */
-#define REAL2	*((atl_real *) &S5)   /* Third real on stack */
-#define SREAL0(x) *((atl_real *) &S1) = (x)
-#define SREAL1(x) *((atl_real *) &S3) = (x)
+#define Rmul(a, b) ((a) * (b))
+#define Rdiv(a, b) ((a) / (b))
+#define Itor(i)  ((atl_real) (i))
+#define Rtoi(r)  ((stackitem) (r))
+#define Dtor(d)  ((atl_real) (d))
+#define Rtod(r)  ((double) (r))
 #endif
 
 /*  File I/O definitions (used only if FILEIO is configured).  */
@@ -0,0 +1,283 @@
+/*
+
+		    ATLAST interpreter benchmark harness
+
+	Loads each Forth program named on the command line and runs
+	the word BENCH it defines, reporting the number of words the
+	inner interpreter executed, the time per word, and the heap
+	high-water of the program: its compiled code and data and the
+	most the heap grew while it ran.  The word count comes from a
+	profiled run of BENCH, which also warms the caches; the time
+	is the best of several unprofiled runs.
+
+	With -s, it first times atl_load() of a generated source of
+	about the given number of bytes, best of the same number of
+	runs, and reports the rate at which it was loaded.
+
+	With -d, it boots from a directory as the firmware does from
+	its flash filesystem: it runs autoexec.fth there, which may
+	INCLUDE other files, and reports how long that took.  It does
+	it twice, unwinding in between, so the second boot uses the
+	caches the first wrote beside the included files.  The
+	programs are then run with the dictionary the boot left.
+
+	With -m, it also reports the free chunks and bytes in the C
+	heap, as glibc's mallinfo2() counts them, before each program
+	loads and after it has been unwound, to show the fragmentation
+	it left behind, as of word names among blocks still held.
+
+	Usage:	program [-r runs] [-h heapcells] [-s bytes] [-d dir] [-m]
+			file.fth ...
+
+	Each program is unwound after it has run, so the next starts
+	with the same dictionary and heap.  Build with "pio run -e
+	native", then, for example, in the firmware directory
+
+		.pio/build/native/program bench/fib.fth bench/sieve.fth
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "atlast.h"
+#ifdef CUSTOM
+#include "atlcfig.h"
+#endif
+#include "atldef.h"
+
+#ifndef PROFILE
+#error "The benchmark harness counts words with PROFILE"
+#endif
+
+/*  NOW  --  Monotonic time in nanoseconds.  */
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cheap = 0;		      /* Report the C heap */
+
+#ifdef __GLIBC__
+
+/*  CHEAPSTAT  --  Count the free chunks and bytes in the C heap.  */
+
+static void cheapstat(size_t *chunks, size_t *bytes)
+{
+    struct mallinfo2 mi = mallinfo2();
+
+    *chunks = mi.ordblks;
+    *bytes = mi.fordblks;
+}
+#else
+static void cheapstat(size_t *chunks, size_t *bytes)
+{
+    *chunks = *bytes = 0;
+}
+#endif
+
+/*  BENCH  --  Load and run one program.  Returns False if it failed
+	       to load or run.  */
+
+static int bench(char *fname, int runs)
+{
+    FILE *fp;
+    atl_statemark mk;
+    stackitem *hmark = hptr, *smark = stk;
+    unsigned long words;
+    long hw;
+    double best = 0;
+    int i, es;
+    size_t fc0, fb0, fc1, fb1;
+
+    cheapstat(&fc0, &fb0);
+#ifdef MEMSTAT
+    heapmax = hptr;		      /* Measure this program alone */
+#endif
+    if ((fp = fopen(fname, "r")) == NULL) {
+	fprintf(stderr, "%s: cannot open\n", fname);
+	return 0;
+    }
+    atl_mark(&mk);
+    es = atl_load(fp);
+    fclose(fp);
+    if (es != ATL_SNORM) {
+	fprintf(stderr, "%s: error %d at line %ld\n", fname, es,
+	    (long) atl_errline);
+	return 0;
+    }
+    if ((es = atl_eval("1 PROFILE BENCH 0 PROFILE")) != ATL_SNORM) {
+	fprintf(stderr, "%s: BENCH failed with error %d\n", fname, es);
+	atl_unwind(&mk);
+	return 0;
+    }
+    words = atl_profwords() - 1;      /* Less the PROFILE that stopped it */
+    stk = smark;		      /* Discard anything BENCH left */
+    for (i = 0; i < runs; i++) {
+	double t = now();
+
+	atl_eval("BENCH");
+	t = now() - t;
+	stk = smark;
+	if (i == 0 || t < best)
+	    best = t;
+    }
+#ifdef MEMSTAT
+    hw = (long) (heapmax - hmark);
+#else
+    hw = (long) (hptr - hmark);       /* Only what the program kept */
+#endif
+    printf("%-16s %12lu %12.0f %8.2f %10ld\n", fname, words, best,
+	(words == 0) ? 0.0 : best / words, hw * (long) sizeof(stackitem));
+    atl_unwind(&mk);
+    if (cheap) {
+	cheapstat(&fc1, &fb1);
+	printf("%-16s C heap free chunks %zu -> %zu, bytes %zu -> %zu\n", "",
+	    fc0, fc1, fb0, fb1);
+    }
+    return 1;
+}
+
+/*  SYNTH  --  Write a source of about nbytes to a temporary file:
+	       a few definitions, then lines of assorted lengths which
+	       use them, with comments of both kinds.  No line is over
+	       132 characters, so atl_fgetsp() loaded it whole.  */
+
+static FILE *synth(long nbytes)
+{
+    FILE *fp = tmpfile();
+    long i;
+
+    if (fp == NULL)
+	return NULL;
+    for (i = 0; i < 64; i++)
+	fprintf(fp, ": W%ld ( n -- n' ) %ld + DUP 1 AND + ;\n", i, i);
+    for (i = 0; ftell(fp) < nbytes; i++) {
+	int j, n = (int) (i % 4) * 2 + 1;
+
+	for (j = 0; j < n; j++)
+	    fprintf(fp, "%ld W%ld ", i + j, (i * 7 + j) % 64);
+	for (j = 1; j < n; j++)
+	    fputs("+ ", fp);
+	fputs((i & 1) ? "DROP ( sum ) \\ a line of arithmetic\n" :
+	    "DROP\n", fp);
+    }
+    rewind(fp);
+    return fp;
+}
+
+/*  LOADBENCH  --  Time loading a generated source.  */
+
+static int loadbench(long nbytes, int runs)
+{
+    FILE *fp = synth(nbytes);
+    long len;
+    double best = 0;
+    int i, es = ATL_SNORM;
+
+    if (fp == NULL) {
+	fprintf(stderr, "Cannot create the source to load\n");
+	return 0;
+    }
+    fseek(fp, 0L, SEEK_END);
+    len = ftell(fp);
+    for (i = 0; i < runs && es == ATL_SNORM; i++) {
+	atl_statemark mk;
+	double t;
+
+	rewind(fp);
+	atl_mark(&mk);
+	t = now();
+	es = atl_load(fp);
+	t = now() - t;
+	atl_unwind(&mk);
+	if (i == 0 || t < best)
+	    best = t;
+    }
+    fclose(fp);
+    if (es != ATL_SNORM) {
+	fprintf(stderr, "Load failed with error %d at line %ld\n", es,
+	    (long) atl_errline);
+	return 0;
+    }
+    printf("Load %ld bytes: %.2f ms, %.1f MB/s\n\n", len, best / 1e6,
+	len / (best / 1e9) / 1e6);
+    return 1;
+}
+
+/*  BOOT  --  Run a directory's autoexec.fth twice, timing each.  */
+
+static int boot(char *dir)
+{
+    atl_statemark mk;
+    double t[2];
+    int i, es = ATL_SNORM;
+
+    atl_incdir = dir;
+    for (i = 0; i < 2 && es == ATL_SNORM; i++) {
+	if (i > 0)
+	    atl_unwind(&mk);
+	atl_mark(&mk);
+	t[i] = now();
+	es = atl_autoexec();
+	t[i] = now() - t[i];
+    }
+    if (es != ATL_SNORM) {
+	fprintf(stderr, "%s/autoexec.fth: error %d at line %ld\n", dir, es,
+	    (long) atl_errline);
+	return 0;
+    }
+    printf("Boot %s: %.3f ms, %.3f ms from the caches\n\n", dir,
+	t[0] / 1e6, t[1] / 1e6);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int i, runs = 5, ok = 1;
+    long sbytes = 0;
+    char *dir = NULL;
+
+    atl_heaplen = 20000;	      /* Room for the sieve's flags */
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+	if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+	    runs = atoi(argv[++i]);
+	} else if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) {
+	    atl_heaplen = atol(argv[++i]);
+	} else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+	    sbytes = atol(argv[++i]);
+	} else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+	    dir = argv[++i];
+	} else if (strcmp(argv[i], "-m") == 0) {
+	    cheap = 1;
+	} else {
+	    fprintf(stderr, "Usage: %s [-r runs] [-h heapcells] [-s bytes] "
+		"[-d dir] [-m] file.fth ...\n", argv[0]);
+	    return 2;
+	}
+    }
+    if (runs < 1)
+	runs = 1;
+    atl_init();
+    if (sbytes > 0 && !loadbench(sbytes, runs))
+	ok = 0;
+    if (dir != NULL && !boot(dir))
+	ok = 0;
+    printf("%-16s %12s %12s %8s %10s\n", "Program", "Words", "ns",
+	"ns/word", "Heap bytes");
+    for (; i < argc; i++) {
+	if (!bench(argv[i], runs))
+	    ok = 0;
+	fflush(stdout);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,342 @@
+/*
+
+		    ATLAST core regression tests
+
+	Evaluates each case in the table below in a fresh state and
+	compares the status atl_eval() returns and the stack it leaves
+	with those expected, printing the cases which differ.  A
+	second table saves words in snapshot images and restores
+	them, whole or damaged.  The exit status is the number of
+	failures.
+
+	Usage:	program [-v]
+
+	With -v, every case is listed as it runs.  Build with "pio run
+	-e native_test", then, in the firmware directory
+
+		.pio/build/native_test/program
+
+	The cases which guard against reading outside arrays are best
+	run with the build flags "-fsanitize=address,undefined" added.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atlast.h"
+#ifdef CUSTOM
+#include "atlcfig.h"
+#endif
+#include "atldef.h"
+
+static struct tcase {
+    char *tsrc; 		      /* Source to evaluate */
+    int tstat;			      /* Status expected */
+    char *tstack;		      /* Stack expected, bottom first */
+} tcases[] = {
+
+    /* Tail calls.  An EXIT may follow a fence, as after THEN, or
+       nothing at all. */
+
+    {": fact dup 1 > if dup 1- fact * then ; 5 fact", ATL_SNORM, "120"},
+    {": x1 ; x1 7", ATL_SNORM, "7"},
+    {": x2 if 1 then ; 0 x2 1 x2", ATL_SNORM, "1"},
+    {": x3 begin 1- dup 0= until ; 5 x3", ATL_SNORM, "0"},
+#ifndef NOPEEPHOLE			      /* Tail calls come from the optimiser */
+    {": x4 dup 0= if exit then 1- x4 ; 100000 x4", ATL_SNORM, "0"},
+#endif
+
+    /* Stack effect verification.  A verified definition checks the
+       stack once on entry, so called with too few items it fails
+       before storing into vs; one the verifier rejects runs checked
+       primitives and fails only at the +, after the store.  Words
+       which merge paths at different depths, run unknown words or
+       call themselves are rejected. */
+
+#ifdef DIRECTTHREAD			      /* Verification needs its inner loop */
+#ifndef NOMEMCHECK
+    {"variable vs : vw 1 vs ! + ; ' vw catch vs @", ATL_SNORM, "-2 0"},
+    {"variable vs : vw 1 vs ! 0= if 1 else 2 then + ; ' vw catch vs @",
+	ATL_SNORM, "-2 0"},
+    {"variable vs : vw 1 vs ! 3 0 do i + loop ; ' vw catch vs @", ATL_SNORM,
+	"-2 0"},
+    {"variable vs : vw 1 vs ! 5 0 do leave loop + ; ' vw catch vs @",
+	ATL_SNORM, "-2 0"},
+    {"variable vs : vw 1 vs ! begin 1 + dup until + ; ' vw catch vs @",
+	ATL_SNORM, "-2 0"},
+    {"variable vs : va + ; : vw 1 vs ! va ; ' vw catch vs @", ATL_SNORM,
+	"-2 0"},
+#endif
+#endif
+    {"variable vs : vw 1 vs ! 0 if 1 then + ; ' vw catch vs @", ATL_SNORM,
+	"-2 1"},
+    {"variable vs : vw 1 vs ! ' drop execute ; ' vw catch vs @", ATL_SNORM,
+	"-2 1"},
+    {"variable vs : vw 1 vs ! dup if 1- vw then drop ; ' vw catch vs @",
+	ATL_SNORM, "-2 1"},
+
+    /* Verified words run unchecked give the same results. */
+
+    {": sq dup * ; : sums 0 swap 0 do i sq + loop ; 10 sums 3 sq", ATL_SNORM,
+	"285 9"},
+    {": v8 1 2 3 4 5 6 7 8 ; v8 v8 + + + + + + + + + + + + + + +", ATL_SNORM,
+	"72"},
+
+    /* Counted strings.  A negative capacity is refused rather than
+       moving the heap back over the dictionary, and one larger than
+       the heap before rounding it up to cells can overflow. */
+
+    {"10 cstring cs1 \"abc\" str>s cs1 cs! cs1 cslen", ATL_SNORM, "3"},
+    {"-100 cstring cs2", ATL_HEAPOVER, ""},
+    {"-100 cstring cs2 1", ATL_HEAPOVER, ""},
+    {"9223372036854775807 cstring cs3 1", ATL_HEAPOVER, ""},
+    {"9223372036854775800 cstring cs3 1", ATL_HEAPOVER, ""},
+
+    /* CATCH and THROW.  The stack is restored to its depth at CATCH,
+       errors are thrown with their status, and a THROW out of
+       EVALUATE unwinds what the string defined, as an error does. */
+
+    {": ct1 1 2 42 throw ; 5 ' ct1 catch", ATL_SNORM, "5 42"},
+    {": ct2 1 2 ; ' ct2 catch", ATL_SNORM, "1 2 0"},
+    {": ct3 1 0 / ; ' ct3 catch", ATL_SNORM, "-13"},
+    {": ct4 -3 throw ; : ct5 ['] ct4 catch throw ; ' ct5 catch", ATL_SNORM,
+	"-3"},
+    {"7 throw 1", ATL_THROW, ""},
+    {": ct6 \" : half 1 [ 2 throw ] ;\" evaluate ; ' ct6 catch", ATL_SNORM,
+	"2"},
+    {": ct6 \" : half 1 [ 2 throw ] ;\" evaluate ; ' ct6 catch half",
+	ATL_UNDEFINED, "2"},
+    {": ct7 \"1 0 /\" evaluate ; : ct8 ['] ct7 catch ; ct8 : ct9 3 ; ct9",
+	ATL_SNORM, "-13 3"},
+
+    /* Tasks.  Each PAUSE of the foreground gives every task a turn,
+       in the order they were started, on stacks of their own.  A
+       task ends when its word returns, is stopped, or fails, which
+       ends only that task. */
+
+    {"variable tc0 : tk0 5 0 do 1 tc0 +! pause loop ; ' tk0 task drop "
+	"pause pause pause tc0 @", ATL_SNORM, "3"},
+    {"variable tc0 : tk0 5 0 do 1 tc0 +! pause loop ; ' tk0 task drop "
+	": tp0 10 0 do pause loop ; tp0 tc0 @", ATL_SNORM, "5"},
+    {"variable tc0 : tk0 begin 1 tc0 +! pause again ; ' tk0 task pause "
+	"stop pause pause tc0 @", ATL_SNORM, "1"},
+    {"variable tc0 : tk0 1 tc0 ! ; : tk1 tc0 @ 10 * 2 + tc0 ! ; "
+	"' tk0 task drop ' tk1 task drop pause tc0 @", ATL_SNORM, "12"},
+    {": tk0 99 ; ' tk0 task drop 7 pause", ATL_SNORM, "7"},
+    {"variable tc0 : tk0 1 0 / ; : tk1 1 tc0 +! ; ' tk0 task drop "
+	"' tk1 task drop pause tc0 @", ATL_SNORM, "1"},
+
+    /* FORGET and a marker end the tasks running the words they
+       remove, before the heap they lay in is reused, and leave
+       those running words which remain. */
+
+    {"variable tc1 : tk1 begin 1 tc1 +! pause again ; ' tk1 task drop "
+	"pause forget tk1 create tz1 1234 , 1234 , 1234 , 1234 , pause "
+	"tc1 @", ATL_SNORM, "1"},
+    {"variable tc2 marker tm2 : tk2 begin 1 tc2 +! pause again ; "
+	"' tk2 task drop pause tm2 create tz2 1234 , 1234 , 1234 , 1234 , "
+	"pause tc2 @", ATL_SNORM, "1"},
+    {"variable tc3 : tk3 begin 1 tc3 +! pause again ; ' tk3 task drop "
+	"marker tm3 : tx3 ; pause tm3 pause tc3 @", ATL_SNORM, "2"},
+
+    /* Compiled code.  Literals, strings and reals must be read back
+       whatever tokens precede them; with TOKTHREAD these decide the
+       short and long literal forms, the alignment of in-line data and
+       the packing of tokens into cells.  SEVEN is defined in a second
+       primitive table. */
+
+    {": l1 32767 -32768 32768 -32769 ; l1", ATL_SNORM,
+	"32767 -32768 32768 -32769"},
+    {": l2 1 drop 9223372036854775807 ; l2", ATL_SNORM,
+	"9223372036854775807"},
+    {": l3 1 drop 1 drop 100000 1 drop ; l3", ATL_SNORM, "100000"},
+    {": s1 1 drop \"abc\" strlen ; s1", ATL_SNORM, "3"},
+    {": r1 1 drop 2.5 2.0 f* fix ; r1", ATL_SNORM, "5"},
+    {": w1 1 ; create x1 5 , x1 @ w1", ATL_SNORM, "5 1"},
+    {": w2 1 drop ; here w2 here =", ATL_SNORM, "-1"},
+    {": k1 create , does> @ 1 drop ; 9 k1 k9 k9", ATL_SNORM, "9"},
+    {": b1 0 200 0 do i 1 and if 1+ else 2 + then 3 drop loop ; b1",
+	ATL_SNORM, "300"},
+    {": p1 1 drop seven seven + ; p1", ATL_SNORM, "14"},
+
+    /* Lookup of primitives.  A definition hides a primitive of the
+       same name until it is forgotten, the first of two primitives of
+       the same name is found, and primitives can't be forgotten. */
+
+    {": dup 1 ; 5 dup", ATL_SNORM, "5 1"},
+    {": dup 1 ; forget dup 5 dup", ATL_SNORM, "5 5"},
+    {": seven 1 ; seven forget seven seven", ATL_SNORM, "1 7"},
+    {"eight", ATL_SNORM, "8"},
+    {"3 ' dup execute ' seven execute", ATL_SNORM, "3 3 7"},
+    {"forget dup 1", ATL_FORGETPROT, ""},
+    {"forget seven 1", ATL_FORGETPROT, ""},
+    {"forget nosuchword 1", ATL_UNDEFINED, ""},
+
+    /* ALLOCATE and RESIZE.  A request larger than the pool is refused
+       with the ior of the word, before its size is rounded up. */
+
+    {"9223372036854775807 allocate swap drop", ATL_SNORM, "-59"},
+    {"-1 allocate swap drop", ATL_SNORM, "-59"},
+    {"16 allocate drop dup 9223372036854775807 resize rot rot over = "
+	"swap free", ATL_SNORM, "-61 -1 0"},
+    {"16 allocate drop 100 resize drop 300 resize drop free", ATL_SNORM, "0"},
+};
+
+/*  Snapshots.  The words sdef defines are saved in an image and
+    forgotten, and sbefore is evaluated to put other words in their
+    place.  The image, less scut bytes from its end, is restored, with
+    the status sstat expected, and suse is evaluated in the result.
+    An image which can't be restored must leave the dictionary as it
+    was.  */
+
+static struct scase {
+    char *sdef; 		      /* Source saved in the image */
+    char *sbefore;		      /* Source evaluated before restoring */
+    long scut;			      /* Bytes cut from the end of the image */
+    int sstat;			      /* Status of restore expected */
+    char *suse; 		      /* Source evaluated after restoring */
+    int ustat;			      /* Status of it expected */
+    char *sstack;		      /* Stack expected, bottom first */
+} scases[] = {
+    {": sq dup * ; variable sv 5 sv !", "", 0, ATL_SNORM, "sv @ sq",
+	ATL_SNORM, "25"},
+    {": sq dup * ;", ": sq 0 ; : other 1 ;", 0, ATL_SNORM, "3 sq", ATL_SNORM,
+	"9"},
+    {": sq dup * ;", ": other 1 ;", 0, ATL_SNORM, "other", ATL_UNDEFINED, ""},
+    {"variable sa 7 sa ! sa constant sp : get sp @ ;", "", 0, ATL_SNORM,
+	"get", ATL_SNORM, "7"},
+    {": konst create , does> @ ; 42 konst k42", "", 0, ATL_SNORM, "k42",
+	ATL_SNORM, "42"},
+    {": sg \"hello\" ; : fr 1.5 2.0 f* fix ;", "", 0, ATL_SNORM,
+	"sg strlen fr", ATL_SNORM, "5 3"},
+    {": sq dup * ;", ": other 1 ;", 1, ATL_BADSNAP, "other", ATL_SNORM, "1"},
+    {": sq dup * ; : cube dup sq * ;", ": other 1 ;", 40, ATL_BADSNAP,
+	"3 sq", ATL_UNDEFINED, "3"},
+};
+
+/*  Primitives in a table of our own, after the built-in ones.  */
+
+prim P_seven()
+{
+    So(1);
+    Push = 7;
+}
+
+prim P_eight()
+{
+    So(1);
+    Push = 8;
+}
+
+static const struct primfcn regprims[] = {
+    {"0SEVEN", P_seven},
+    {"0EIGHT", P_eight},
+    {"0EIGHT", P_seven},		      /* Hidden by the first */
+    {NULL, (codeptr) 0}
+};
+
+/*  STACKSTR  --  Edit the stack above a mark into a string.  */
+
+static void stackstr(char *buf, size_t len, stackitem *smark)
+{
+    stackitem *sp;
+    size_t l = 0;
+
+    buf[0] = '\0';
+    for (sp = smark; sp < stk && l + 24 < len; sp++)
+	l += sprintf(buf + l, (sp == smark) ? "%ld" : " %ld", (long) *sp);
+}
+
+int main(int argc, char *argv[])
+{
+    int verbose = (argc > 1 && strcmp(argv[1], "-v") == 0);
+    unsigned int i, j, fails = 0;
+    stackitem *smark;
+    char got[256];
+
+    atl_init();
+    atl_primdef(regprims);
+    smark = stk;
+    for (i = 0; i < sizeof tcases / sizeof tcases[0]; i++) {
+	struct tcase *tc = &tcases[i];
+	atl_statemark mk;
+	int es;
+
+	if (verbose)
+	    printf("%s\n", tc->tsrc);
+	atl_mark(&mk);
+	es = atl_eval(tc->tsrc);
+	stackstr(got, sizeof got, smark);
+	if (es != tc->tstat || strcmp(got, tc->tstack) != 0) {
+	    printf("\nFAIL: %s\n  status %d, expected %d\n"
+		"  stack \"%s\", expected \"%s\"\n", tc->tsrc, es, tc->tstat,
+		got, tc->tstack);
+	    fails++;
+	}
+	stk = smark;
+	atl_unwind(&mk);
+    }
+    for (j = 0; j < sizeof scases / sizeof scases[0]; j++, i++) {
+	struct scase *sc = &scases[j];
+	atl_statemark mk;
+	char *image = NULL;
+	long len;
+	int es, us;
+
+	if (verbose)
+	    printf("%s | %s\n", sc->sdef, sc->suse);
+	atl_mark(&mk);
+	es = atl_eval(sc->sdef);
+	if (es == ATL_SNORM && (len = atl_snapsave(NULL, 0)) > 0 &&
+	    (image = (char *) malloc(len)) != NULL &&
+	    atl_snapsave(image, len) == len) {
+	    atl_unwind(&mk);
+	    es = atl_eval(sc->sbefore);
+	    if (es == ATL_SNORM)
+		es = atl_snaprestore(image, len - sc->scut);
+	} else
+	    es = ATL_SNORM - 1;       /* Couldn't make the image */
+	free(image);
+	us = atl_eval(sc->suse);
+	stackstr(got, sizeof got, smark);
+	if (es != sc->sstat || us != sc->ustat ||
+	    strcmp(got, sc->sstack) != 0) {
+	    printf("\nFAIL: %s | %s\n  restore %d, expected %d\n"
+		"  status %d, expected %d\n  stack \"%s\", expected \"%s\"\n",
+		sc->sdef, sc->suse, es, sc->sstat, us, sc->ustat, got,
+		sc->sstack);
+	    fails++;
+	}
+	stk = smark;
+	atl_unwind(&mk);
+    }
+    /* atl_defined() of words kept and forgotten, of primitives and
+       of an address which was never a word. */
+
+    {
+	atl_statemark mk;
+	dictword *d1, *d2;
+	int got1, got2;
+
+	atl_mark(&mk);
+	(void) atl_eval(": dd1 ; : dd2 ;");
+	d1 = atl_lookup("dd1");
+	d2 = atl_lookup("dd2");
+	(void) atl_eval("forget dd2");
+	got1 = atl_defined(d1);
+	got2 = atl_defined(d2);
+	if (!got1 || got2 || !atl_defined(atl_lookup("dup")) ||
+	    !atl_defined(atl_lookup("seven")) ||
+	    atl_defined((dictword *) &mk)) {
+	    printf("\nFAIL: atl_defined() of kept %d, forgotten %d\n", got1,
+		got2);
+	    fails++;
+	}
+	i++;
+	atl_unwind(&mk);
+    }
+    printf("\n%u cases, %u failed\n", i, fails);
+    return (int) fails;
+}
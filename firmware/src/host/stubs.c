@@ -0,0 +1,35 @@
+/*
+
+		   Host stand-ins for the firmware's hooks
+
+	The firmware configuration (atlcfig.h) routes keyboard polling,
+	the profiler clock and word deletion to functions main.cpp
+	implements on the ESP32.  These versions let the ATLAST core
+	build and run on a workstation in the native environment.
+
+*/
+
+#include <time.h>
+
+/*  KEYHIT_IMPL  --  No key is ever waiting.  */
+
+int Keyhit_impl()
+{
+    return 0;
+}
+
+/*  PROFCLOCK_IMPL  --  Profiler clock: nanoseconds.  */
+
+unsigned long Profclock_impl()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long) ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/*  FORGOTTEN_IMPL  --  Words were deleted: the host holds none.  */
+
+void Forgotten_impl()
+{
+}
@@ -0,0 +1,135 @@
+/*
+
+		  ATLAST independent instance stress test
+
+	Starts a number of threads, each of which creates its own
+	ATLAST instance with atl_vmnew() and evaluates in it
+	concurrently with the others.  Every instance defines the
+	same names with different bodies, compiles, runs and forgets
+	words many times over, and checks its results at the end, so
+	any state the instances share by mistake shows up as a wrong
+	answer or a sanitizer report.  Finally one instance is left
+	looping and broken from the main thread with atl_vmbreak().
+
+	Usage:	program [threads]
+
+	The default is 8 threads.  Build with "pio run -e native_mvm",
+	then, in the firmware directory
+
+		.pio/build/native_mvm/program
+
+	It is best run with "-fsanitize=thread" or "-fsanitize=address"
+	added to the build flags.  ThreadSanitizer reports the store
+	atl_vmbreak() makes to the instance's break flag, which, like
+	atl_break() from a signal handler, is asynchronous by design.
+	The exit status is the number of threads which failed.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "atlast.h"
+#ifdef CUSTOM
+#include "atlcfig.h"
+#endif
+#include "atldef.h"
+
+#ifndef MULTIVM
+#error This test needs the MULTIVM build flag
+#endif
+
+#define Maxthreads  64		      /* Most threads we'll start */
+#define Iters	    2000	      /* Iterations in each thread */
+
+static atl_vm *vms[Maxthreads];       /* Instance of each thread */
+static int vfails[Maxthreads];	      /* Failures in each thread */
+static atomic_int spinning;	      /* Thread 0 is waiting for break */
+
+/*  CHECK  --  Evaluate a string in the current instance and compare
+	       the top of the stack, if any, with that expected.  */
+
+static void check(long id, char *src, int depth, stackitem top)
+{
+    int es = atl_eval(src);
+
+    if (es != ATL_SNORM || (stk - stackbot) != depth ||
+	(depth > 0 && stk[-1] != top)) {
+	printf("thread %ld: \"%s\" status %d, depth %ld, top %ld\n", id, src,
+	    es, (long) (stk - stackbot), (long) (depth > 0 ? stk[-1] : 0));
+	vfails[id]++;
+    }
+}
+
+/*  WORKER  --  Body of each thread.  */
+
+static void *worker(void *arg)
+{
+    long id = (long) arg, i;
+    char buf[128];
+
+    vms[id] = atl_vmnew();
+    atl_vmselect(vms[id]);
+
+    /* The same names in every instance, with different bodies. */
+
+    sprintf(buf, ": id %ld ; variable acc : bump acc @ id + acc ! ;", id);
+    check(id, buf, 0, 0);
+    check(id, ": fib dup 2 < if exit then dup 1- fib swap 2 - fib + ;", 0, 0);
+    for (i = 0; i < Iters; i++) {
+	check(id, "bump 15 fib drop", 0, 0);
+	sprintf(buf, ": t%ld %ld ; t%ld forget t%ld", i, i, i, i);
+	check(id, buf, 1, i);
+	check(id, "drop", 0, 0);
+    }
+    check(id, "acc @", 1, id * Iters);
+    check(id, "drop 20 fib", 1, 6765);
+    check(id, "drop", 0, 0);
+
+    /* Thread 0 loops until the main thread breaks it. */
+
+    if (id == 0) {
+	int es;
+
+	check(id, ": spin begin 0 until ;", 0, 0);
+	atomic_store(&spinning, 1);
+	if ((es = atl_eval("spin")) != ATL_BREAK) {
+	    printf("thread 0: spin status %d, expected %d\n", es, ATL_BREAK);
+	    vfails[id]++;
+	}
+    }
+    atl_vmselect(NULL);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    pthread_t th[Maxthreads];
+    int nthreads = (argc > 1) ? atoi(argv[1]) : 8, fails = 0;
+    long i;
+
+    if (nthreads < 1 || nthreads > Maxthreads) {
+	fprintf(stderr, "Threads must be from 1 to %d.\n", Maxthreads);
+	return 2;
+    }
+    atl_init(); 		      /* Default instance defines primitives */
+    for (i = 0; i < nthreads; i++)
+	pthread_create(&th[i], NULL, worker, (void *) i);
+    for (i = 1; i < nthreads; i++)
+	pthread_join(th[i], NULL);
+    while (!atomic_load(&spinning))
+	usleep(1000);
+    usleep(20000);
+    atl_vmbreak(vms[0]);
+    pthread_join(th[0], NULL);
+    for (i = 0; i < nthreads; i++) {
+	atl_vmfree(vms[i]);
+	if (vfails[i] != 0)
+	    fails++;
+    }
+    printf("\n%d threads, %d failed\n", nthreads, fails);
+    return fails;
+}
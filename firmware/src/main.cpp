@@ -1,10 +1,14 @@
 #include <Arduino.h>
+#include <freertos/stream_buffer.h>
+#include <LittleFS.h>
 #include <NimBLEDevice.h>
 #include <Preferences.h>
 #include <TM1650.h>
 #include <TM16xxDisplay.h>
 
+#include <atomic>
 #include <set>
+#include <vector>
 
 extern "C" {
     #include "atlast.h"
@@ -57,11 +61,43 @@ static SemaphoreHandle_t g_allowlist_mutex = xSemaphoreCreateMutex();
 /* =========================================================
  * BLE 通知处理
  * ========================================================= */
+// 心率样本环形队列：BLE 主机任务是唯一的生产者，forth_cli 任务是唯一的消费者。
+// 双方各自只写 head 或 tail，不加锁，生产者从不等待解释器；队列满时丢弃并计数。
+struct HrSample {
+    uint32_t t_ms;          // 收到通知的时间（与 NOW 相同的时基）
+    uint16_t hr;            // 心率 bpm
+};
+
+static const uint32_t k_hr_ring_size = 128;     // 2 的幂；每秒 10 个样本时可缓存 12 秒
+static HrSample g_hr_ring[k_hr_ring_size];
+static std::atomic<uint32_t> g_hr_head{0};      // 生产者写入
+static std::atomic<uint32_t> g_hr_tail{0};      // 消费者写入
+static std::atomic<uint32_t> g_hr_received{0};
+static std::atomic<uint32_t> g_hr_dropped{0};
+static std::atomic<bool> g_hr_queue_on{false};  // 注册了 Forth 处理字时才入队
+
+static void HrQueuePush(uint16_t hr) {
+    uint32_t head = g_hr_head.load(std::memory_order_relaxed);
+    uint32_t tail = g_hr_tail.load(std::memory_order_acquire);
+
+    g_hr_received.fetch_add(1, std::memory_order_relaxed);
+    if (head - tail >= k_hr_ring_size) {
+        g_hr_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    HrSample &s = g_hr_ring[head & (k_hr_ring_size - 1)];
+    s.t_ms = (uint32_t) (esp_timer_get_time() / 1000);
+    s.hr = hr;
+    g_hr_head.store(head + 1, std::memory_order_release);
+}
+
 void HrNotifyCallback(NimBLERemoteCharacteristic* chr, uint8_t* data, size_t len, bool is_notify) {
-    if (len < 1) return;
+    // 心率数据解析：第1字节是Flag，bit0 为 1 时 HR 值是16位，否则是8位
+    if (len < 2) return;
+    bool hr16 = data[0] & 0x01;
+    if (hr16 && len < 3) return;
 
-    // 心率数据解析：通常第1字节是Flag，第2字节是HR值
-    uint8_t hr = (data[0] & 0x01) ? (data[1] | (data[2] << 8)) : data[1];
+    uint16_t hr = hr16 ? (data[1] | (data[2] << 8)) : data[1];
 
     // 串口输出心率值
     if (hr > 0 && hr != g_hr) {
@@ -69,7 +105,11 @@ void HrNotifyCallback(NimBLERemoteCharacteristic* chr, uint8_t* data, size_t len
     }
 
     // 更新全局变量
-    g_hr = hr;
+    g_hr = hr > 255 ? 255 : hr;
+
+    if (g_hr_queue_on.load(std::memory_order_relaxed)) {
+        HrQueuePush(hr);
+    }
 }
 
 /* =========================================================
@@ -250,6 +290,76 @@ static void LoadSettings() {
     g_prefs.end();
 }
 
+/* =========================================================
+ * Forth 词典快照的保存和恢复
+ * ========================================================= */
+// 快照单独使用一个命名空间，SaveSettings 的 clear() 不会清除它
+const char* k_snap_namespace = "forth_snap";
+
+static void SaveSnapshot() {
+    long len = atl_snapsave(NULL, 0);
+    if (len == 0) {
+        ERROR printf("[SNAP] Cannot save while compiling.\n");
+        return;
+    }
+
+    char *buf = (char *)malloc(len);
+    if (buf == NULL) {
+        ERROR printf("[SNAP] Out of memory (%ld bytes).\n", len);
+        return;
+    }
+    atl_snapsave(buf, len);
+
+    g_prefs.begin(k_snap_namespace, false);
+    size_t written = g_prefs.putBytes("image", buf, len);
+    g_prefs.end();
+    free(buf);
+
+    if (written != (size_t)len) {
+        ERROR printf("[SNAP] Failed to write %ld bytes to NVS.\n", len);
+    } else {
+        INFO printf("[SNAP] Saved %ld bytes to NVS.\n", len);
+    }
+}
+
+static void EraseSnapshot() {
+    g_prefs.begin(k_snap_namespace, false);
+    g_prefs.remove("image");
+    g_prefs.end();
+
+    INFO printf("[SNAP] Snapshot erased.\n");
+}
+
+// 启动时恢复快照，须在定义完所有原语之后调用
+static void RestoreSnapshot() {
+    g_prefs.begin(k_snap_namespace, true);
+    size_t len = g_prefs.isKey("image") ? g_prefs.getBytesLength("image") : 0;
+    if (len == 0) {
+        g_prefs.end();
+        return;
+    }
+
+    char *buf = (char *)malloc(len);
+    if (buf == NULL) {
+        g_prefs.end();
+        ERROR printf("[SNAP] Out of memory (%u bytes).\n", (unsigned)len);
+        return;
+    }
+    g_prefs.getBytes("image", buf, len);
+    g_prefs.end();
+
+    uint32_t start = micros();
+    int ret = atl_snaprestore(buf, len);
+    uint32_t elapsed = micros() - start;
+    free(buf);
+
+    if (ret != ATL_SNORM) {
+        ERROR printf("[SNAP] Snapshot is not compatible with this firmware.\n");
+    } else {
+        INFO printf("[SNAP] Restored %u bytes in %u us.\n", (unsigned)len, (unsigned)elapsed);
+    }
+}
+
 /* =========================================================
  * forth解释器任务及相关的词
  * ========================================================= */
@@ -403,18 +513,356 @@ static void forth_digital_write() {
     digitalWrite(pin, val);
 }
 
+/* =========================================================
+ * 周期执行 Forth 字
+ * ========================================================= */
+// 作业按到期时间存放在二叉小顶堆中，取出和重新插入都是 O(log n)。
+// 解释器不可重入，作业只在 forth_cli 任务中执行：
+// 该任务按最近的到期时间设置阻塞超时，由 FreeRTOS 按时唤醒。
+struct ForthJob {
+    dictword *word;         // 要执行的字
+    atl_int id;             // 作业号
+    int64_t due_us;         // 下次到期时间
+    int64_t period_us;      // 周期，0 表示只执行一次
+    size_t slot;            // 在堆中的位置，不在堆中时为 k_job_none
+    bool running;           // 正在执行
+    uint32_t runs;          // 执行次数
+    uint32_t missed;        // 因执行过晚而跳过的周期数
+    int64_t lat_min_us;     // 启动延迟（实际开始时间 - 到期时间）统计
+    int64_t lat_max_us;
+    int64_t lat_sum_us;
+};
+
+static const size_t k_job_none = (size_t) -1;
+static std::vector<ForthJob *> g_jobs;
+static atl_int g_job_seq = 0;
+static bool g_jobs_active = false;
+
+static bool JobEarlier(size_t a, size_t b) {
+    return g_jobs[a]->due_us < g_jobs[b]->due_us;
+}
+
+static void JobSwap(size_t a, size_t b) {
+    std::swap(g_jobs[a], g_jobs[b]);
+    g_jobs[a]->slot = a;
+    g_jobs[b]->slot = b;
+}
+
+static void JobSiftUp(size_t i) {
+    while (i > 0 && JobEarlier(i, (i - 1) / 2)) {
+        JobSwap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void JobSiftDown(size_t i) {
+    for (;;) {
+        size_t l = 2 * i + 1, r = l + 1, m = i;
+
+        if (l < g_jobs.size() && JobEarlier(l, m)) m = l;
+        if (r < g_jobs.size() && JobEarlier(r, m)) m = r;
+        if (m == i) break;
+        JobSwap(i, m);
+        i = m;
+    }
+}
+
+static void JobInsert(ForthJob *job) {
+    job->slot = g_jobs.size();
+    g_jobs.push_back(job);
+    JobSiftUp(job->slot);
+}
+
+static void JobRemove(ForthJob *job) {
+    size_t i = job->slot;
+
+    JobSwap(i, g_jobs.size() - 1);
+    g_jobs.pop_back();
+    if (i < g_jobs.size()) {
+        JobSiftDown(i);
+        JobSiftUp(i);
+    }
+    job->slot = k_job_none;
+}
+
+// 执行所有已到期的作业，返回距下一个作业到期的 tick 数。
+// 每次调用中每个作业至多执行一次，执行时间超过周期的作业不会独占 CLI。
+static TickType_t RunDueJobs() {
+    if (g_jobs_active) {
+        return portMAX_DELAY;   // 作业中调用 0MS 时不嵌套执行作业
+    }
+    g_jobs_active = true;
+
+    int64_t start = esp_timer_get_time();
+    TickType_t wait = portMAX_DELAY;
+
+    while (!g_jobs.empty()) {
+        ForthJob *job = g_jobs[0];
+        int64_t now = esp_timer_get_time();
+
+        if (job->due_us > start) {
+            TickType_t ticks = pdMS_TO_TICKS((job->due_us - now + 999) / 1000);
+            wait = (job->due_us <= now || ticks == 0) ? 1 : ticks;
+            break;
+        }
+
+        int64_t lat = now - job->due_us;
+        if (job->runs == 0 || lat < job->lat_min_us) job->lat_min_us = lat;
+        if (job->runs == 0 || lat > job->lat_max_us) job->lat_max_us = lat;
+        job->lat_sum_us += lat;
+        job->runs++;
+
+        if (job->period_us > 0) {
+            job->due_us += job->period_us;
+            if (job->due_us <= now) {
+                int64_t skip = (now - job->due_us) / job->period_us + 1;
+                job->missed += skip;
+                job->due_us += skip * job->period_us;
+            }
+            JobSiftDown(0);
+        } else {
+            JobRemove(job);
+        }
+
+        job->running = true;
+        int ret = atl_exec(job->word);
+        job->running = false;
+        if (ret != ATL_SNORM && job->slot != k_job_none) {
+            ERROR printf("[JOB] Job %ld (%s) failed (%d), cancelled.\n",
+                (long) job->id, job->word->wname + 1, ret);
+            JobRemove(job);
+        }
+        if (job->slot == k_job_none) {
+            delete job;
+        }
+    }
+
+    g_jobs_active = false;
+    return wait;
+}
+
+static void forth_job_add(int64_t due_us, int64_t period_us) {
+    if (!atl_defined((dictword *) S1)) {
+        ERROR printf("[JOB] Not a word.\n");
+        Pop;
+        S0 = 0;
+        return;
+    }
+
+    ForthJob *job = new ForthJob();
+
+    job->word = (dictword *) S1;
+    job->id = ++g_job_seq;
+    job->due_us = due_us;
+    job->period_us = period_us;
+    JobInsert(job);
+    Pop;
+    S0 = job->id;
+}
+
+static void forth_job_every() {
+    Sl(2);
+    if (S0 <= 0) {
+        ERROR printf("[JOB] Period must be positive.\n");
+        Pop;
+        S0 = 0;
+        return;
+    }
+    int64_t period_us = (int64_t) S0 * 1000;
+    forth_job_add(esp_timer_get_time() + period_us, period_us);
+}
+
+static void forth_job_at() {
+    Sl(2);
+    forth_job_add((int64_t) S0 * 1000, 0);
+}
+
+static void forth_job_cancel() {
+    Sl(1);
+    for (ForthJob *job : g_jobs) {
+        if (job->id == S0) {
+            JobRemove(job);
+            if (!job->running) {
+                delete job;     // 正在执行的作业由 RunDueJobs() 释放
+            }
+            break;
+        }
+    }
+    Pop;
+}
+
+// 字被删除后取消执行它的作业（由 Forgotten_impl() 调用）。
+// atl_defined() 对堆中的字只比较地址，每个作业的检查是常数时间。
+// 先收集再移除：JobRemove() 会调整堆中其余作业的位置
+static void JobsForgotten() {
+    std::vector<ForthJob *> gone;
+
+    for (ForthJob *job : g_jobs) {
+        if (!atl_defined(job->word)) {
+            gone.push_back(job);
+        }
+    }
+    for (ForthJob *job : gone) {
+        ERROR printf("[JOB] Job %ld: word forgotten, cancelled.\n", (long) job->id);
+        JobRemove(job);
+        if (!job->running) {
+            delete job;         // 正在执行的作业由 RunDueJobs() 释放
+        }
+    }
+}
+
+static void forth_job_list() {
+    printf("%-4s %-16s %8s %8s %6s %8s %8s %8s\n",
+        "ID", "Word", "Period", "Runs", "Miss", "LatMin", "LatAvg", "LatMax");
+    for (ForthJob *job : g_jobs) {
+        printf("%-4ld %-16.16s %8ld %8lu %6lu %8ld %8ld %8ld\n",
+            (long) job->id, job->word->wname + 1,
+            (long) (job->period_us / 1000),
+            (unsigned long) job->runs, (unsigned long) job->missed,
+            (long) job->lat_min_us,
+            (long) (job->runs ? job->lat_sum_us / job->runs : 0),
+            (long) job->lat_max_us);
+    }
+}
+
+static void forth_now() {
+    So(1);
+    Push = (atl_int) (esp_timer_get_time() / 1000);
+}
+
+/* =========================================================
+ * 心率事件的 Forth 处理字
+ * ========================================================= */
+// forth_cli 任务成批取出队列中的样本，逐个以 ( hr ms -- ) 调用处理字。
+// 注册了处理字时，该任务最多等待 k_hr_poll_ms 就检查一次队列
+static const uint32_t k_hr_poll_ms = 20;
+static const uint32_t k_hr_batch = 16;
+static dictword *g_hr_handler = nullptr;
+static uint32_t g_hr_handled = 0;
+static uint32_t g_hr_backlog_max = 0;
+static bool g_hr_active = false;
+
+// 处理队列中已有的样本，返回下次检查前可等待的 tick 数
+static TickType_t RunHrHandler() {
+    if (g_hr_handler == nullptr || g_hr_active) {
+        return portMAX_DELAY;   // 处理字中调用 0MS 时不嵌套执行处理字
+    }
+    g_hr_active = true;
+
+    uint32_t tail = g_hr_tail.load(std::memory_order_relaxed);
+    uint32_t head = g_hr_head.load(std::memory_order_acquire);
+
+    if (head - tail > g_hr_backlog_max) {
+        g_hr_backlog_max = head - tail;
+    }
+
+    // 只处理进入时已在队列中的样本，处理字运行期间新到的留待下一轮
+    while (tail != head && g_hr_handler != nullptr) {
+        HrSample batch[k_hr_batch];
+        uint32_t n = 0;
+
+        while (tail != head && n < k_hr_batch) {
+            batch[n++] = g_hr_ring[tail++ & (k_hr_ring_size - 1)];
+        }
+        g_hr_tail.store(tail, std::memory_order_release);   // 先腾出位置再执行处理字
+
+        for (uint32_t i = 0; i < n && g_hr_handler != nullptr; i++) {
+            if (stk + 2 > stacktop) {
+                ERROR printf("[HR] Stack overflow, handler skipped.\n");
+                break;
+            }
+            Push = (atl_int) batch[i].hr;
+            Push = (atl_int) batch[i].t_ms;
+
+            dictword *handler = g_hr_handler;
+            int ret = atl_exec(handler);
+            g_hr_handled++;
+            if (ret != ATL_SNORM && g_hr_handler == handler) {
+                ERROR printf("[HR] Handler %s failed (%d), removed.\n", handler->wname + 1, ret);
+                g_hr_queue_on.store(false, std::memory_order_relaxed);
+                g_hr_handler = nullptr;
+            }
+        }
+    }
+
+    g_hr_active = false;
+    return pdMS_TO_TICKS(k_hr_poll_ms);
+}
+
+// 处理字被删除后取消注册（由 Forgotten_impl() 调用）
+static void HrForgotten() {
+    if (g_hr_handler != nullptr && !atl_defined(g_hr_handler)) {
+        ERROR printf("[HR] Handler forgotten, removed.\n");
+        g_hr_queue_on.store(false, std::memory_order_relaxed);
+        g_hr_handler = nullptr;
+    }
+}
+
+// ( word -- ) 注册心率处理字，0 表示取消
+static void forth_hr_handler() {
+    Sl(1);
+    dictword *handler = (dictword *) S0;
+    Pop;
+
+    if (handler != nullptr && !atl_defined(handler)) {
+        ERROR printf("[HR] Not a word.\n");
+        return;
+    }
+
+    g_hr_queue_on.store(false, std::memory_order_relaxed);
+    g_hr_handler = handler;
+    if (handler != nullptr) {
+        // 丢弃注册之前的旧样本；tail 只由本任务写入，直接跳到 head 即可
+        g_hr_tail.store(g_hr_head.load(std::memory_order_acquire), std::memory_order_release);
+        g_hr_queue_on.store(true, std::memory_order_relaxed);
+    }
+}
+
+static void forth_hr_stat() {
+    printf("Handler  %s\n", g_hr_handler ? g_hr_handler->wname + 1 : "-");
+    printf("Received %lu\n", (unsigned long) g_hr_received.load());
+    printf("Handled  %lu\n", (unsigned long) g_hr_handled);
+    printf("Dropped  %lu\n", (unsigned long) g_hr_dropped.load());
+    printf("Backlog  %lu / %lu\n", (unsigned long) g_hr_backlog_max, (unsigned long) k_hr_ring_size);
+}
+
 static void forth_delay_ms() {
     Sl(1);
-    int ms = (int)S0;
+    TickType_t now = xTaskGetTickCount();
+
+    // 首次执行时把毫秒数换成截止 tick，留在栈上供让出后再次执行时使用
+    if (!atl_resumed()) {
+        S0 = (atl_int) (now + pdMS_TO_TICKS(S0));
+    }
+    TickType_t until = (TickType_t) S0;
+
+    // 后台 Forth 任务：未到期就让给下一个任务
+    if ((int32_t) (until - now) > 0 && atl_pause()) {
+        return;
+    }
     Pop;
 
-    vTaskDelay(pdMS_TO_TICKS(ms));
+    // 前台：等待期间执行到期的作业和心率处理字，并每个 tick 让后台任务运行一轮
+    TickType_t left;
+    while ((int32_t) (left = until - xTaskGetTickCount()) > 0) {
+        TickType_t next = RunDueJobs();
+        TickType_t hr_next = RunHrHandler();
+        if (hr_next < next) {
+            next = hr_next;
+        }
+        if (atl_tasks() != 0) {
+            next = 1;
+        }
+        vTaskDelay(next < left ? next : left);
+    }
 }
 
-static struct primfcn my_primitives[] = {
+static const struct primfcn my_primitives[] = {
     {"0VER", forth_version},
 
     {"0HR", forth_get_hr},
+    {"0ONHR", forth_hr_handler},
+    {"0HR?", forth_hr_stat},
 
     {"0BR!", forth_set_br},
     {"0BR@", forth_get_br},
@@ -431,6 +879,9 @@ static struct primfcn my_primitives[] = {
 
     {"0SAVE", SaveSettings},
 
+    {"0SNAP!", SaveSnapshot},
+    {"0SNAP-", EraseSnapshot},
+
     {"0PS", forth_list_tasks},
     {"0REBOOT", esp_restart},
 
@@ -438,6 +889,12 @@ static struct primfcn my_primitives[] = {
     {"0PIN!", forth_digital_write},
     {"0MS", forth_delay_ms},
 
+    {"0NOW", forth_now},
+    {"0EVERY", forth_job_every},
+    {"0AT", forth_job_at},
+    {"0CANCEL", forth_job_cancel},
+    {"0JOBS", forth_job_list},
+
     {NULL, NULL}
 };
 
@@ -446,6 +903,76 @@ static inline void flush_stdout() {
     fsync(fileno(stdout));
 }
 
+/* =========================================================
+ * 串口接收与异步中断
+ * ========================================================= */
+// 串口接收回调把字符放入流缓冲区，由 Forth 任务读取
+static StreamBufferHandle_t g_rx_stream = nullptr;
+// 执行用户输入或开机脚本时，ESC/q/Q 不进入缓冲区，而是请求中断
+static volatile bool g_forth_busy = false;
+// 在提示符下运行作业、心率处理字和后台任务时只有 ESC 请求中断，
+// q/Q 仍是正在输入的行的一部分
+static volatile bool g_forth_idle = false;
+
+static void SerialRxHandler() {
+    while (Serial.available()) {
+        char c = Serial.read();
+
+        if ((g_forth_busy && (c == 27 || c == 'q' || c == 'Q')) ||
+            (g_forth_idle && c == 27)) {
+            atl_break();
+            continue;
+        }
+        xStreamBufferSend(g_rx_stream, &c, 1, 0);
+    }
+}
+
+#if ARDUINO_USB_CDC_ON_BOOT
+static void SerialRxEvent(void* arg, esp_event_base_t base, int32_t id, void* data) {
+    SerialRxHandler();
+}
+#endif
+
+static void SerialRxBegin() {
+    g_rx_stream = xStreamBufferCreate(256, 1);
+#if ARDUINO_USB_CDC_ON_BOOT
+    Serial.onEvent(ARDUINO_HW_CDC_RX_EVENT, SerialRxEvent);
+#else
+    Serial.onReceive(SerialRxHandler);
+#endif
+}
+
+/* =========================================================
+ * 文件系统与开机脚本
+ * ========================================================= */
+// LittleFS 挂载在 /littlefs，INCLUDE 的文件名相对于这个目录。
+// 用 pio run -t uploadfs 把 bench/boot 目录中的脚本写入文件系统
+// （platformio.ini 中 data_dir 指向该目录）
+static const char *k_fs_root = "/littlefs";
+
+// 开机时执行 autoexec.fth，每次都从源码加载，所以可以在其中启动作业、设置引脚。
+// 它 INCLUDE 的文件在源码及之前的词典都未改变时，从旁边的 .fthc 缓存直接恢复，不再编译
+static void RunAutoexec() {
+    // 第一个参数为 true：分区中还没有文件系统时先格式化
+    if (!LittleFS.begin(true, k_fs_root)) {
+        ERROR printf("[FS] Cannot mount LittleFS.\n");
+        return;
+    }
+    atl_incdir = (char *) k_fs_root;
+
+    uint32_t start = micros();
+    g_forth_busy = true;    // 允许用 ESC 中断失控的开机脚本
+    int ret = atl_autoexec();
+    g_forth_busy = false;
+    uint32_t elapsed = micros() - start;
+
+    if (ret != ATL_SNORM) {
+        ERROR printf("\n[FS] autoexec.fth failed with error %d at line %ld.\n", ret, (long) atl_errline);
+    } else {
+        INFO printf("[FS] autoexec.fth done in %u us.\n", (unsigned) elapsed);
+    }
+}
+
 void ForthTask(void* arg) {
     char input_buffer[128];
     int idx = 0;
@@ -453,21 +980,27 @@ void ForthTask(void* arg) {
     // 初始化 Atlast 实例
     atl_init();
     atl_primdef(my_primitives);
+    RestoreSnapshot();
+    RunAutoexec();
 
     printf("[FORTH] Interpreter Ready.\n");
     printf("[FORTH] ");
     flush_stdout();
 
+    TickType_t wait = portMAX_DELAY;
+
     for (;;) {
-        if (Serial.available()) {
-            char c = Serial.read();
+        char c;
 
+        if (xStreamBufferReceive(g_rx_stream, &c, 1, wait) == 1) {
             if (c == '\n') {
                 input_buffer[idx] = '\0';
                 if (idx > 0) {
                     printf(" ");
                     flush_stdout();
+                    g_forth_busy = true;
                     int ret = atl_eval(input_buffer);
+                    g_forth_busy = false;
                     if (ret == ATL_SNORM) {
                         printf(state || atl_comment ? "\n" : " ok\n");
                     } else if (ret == ATL_UNDEFINED) { // 错误信息没有换行的情况
@@ -502,23 +1035,50 @@ void ForthTask(void* arg) {
                 flush_stdout();
             }
         }
-        vTaskDelay(pdMS_TO_TICKS(10));
+
+        // 执行到期的作业和心率处理字；有后台 Forth 任务时每个 tick 运行一轮。
+        // 下次等待到最近的作业到期或下次检查心率队列，都没有就一直等待输入
+        g_forth_idle = true;
+        wait = RunDueJobs();
+        TickType_t hr_wait = RunHrHandler();
+        if (hr_wait < wait) {
+            wait = hr_wait;
+        }
+        if (atl_tasks() != 0) {
+            wait = 1;
+        }
+        g_forth_idle = false;
+        flush_stdout();
     }
 }
 
 // Atlast的键盘交互实现
 extern "C" {
     int Keyhit_impl() {
+        char c;
+
         flush_stdout();
 
-        if (Serial.available()) {
-            return Serial.read();
+        if (xStreamBufferReceive(g_rx_stream, &c, 1, 0) == 1) {
+            return c;
         }
 
         taskYIELD();
 
         return 0;
     }
+
+    // 性能分析时钟（atlcfig.h 中定义 PROFILE 时使用）
+    unsigned long Profclock_impl() {
+        return ESP.getCycleCount();
+    }
+
+    // FORGET、标记回滚或快照恢复删除了字：丢弃仍指向已删除字的作业和
+    // 心率处理字，否则它们会以悬空指针调用 atl_exec()
+    void Forgotten_impl() {
+        JobsForgotten();
+        HrForgotten();
+    }
 }
 
 /* =========================================================
@@ -526,6 +1086,7 @@ extern "C" {
  * ========================================================= */
 void setup() {
     Serial.begin(115200);
+    SerialRxBegin();
 
     INFO printf("\n[SYS] ESP32-C3 HR Monitor Starting...\n");
 
@@ -552,7 +1113,8 @@ void setup() {
     // 创建 FreeRTOS 任务
     xTaskCreate(HrManagerTask, "hr_mgr", 4096, nullptr, 10, nullptr);
     xTaskCreate(DisplayTask,   "ds_mgr", 2048, nullptr,  5, nullptr);
-    xTaskCreate(ForthTask,  "forth_cli", 4096, nullptr,  2, nullptr);
+    // Forth 任务要经 INCLUDE 读写 LittleFS，栈比其他任务大一些
+    xTaskCreate(ForthTask,  "forth_cli", 6144, nullptr,  2, nullptr);
 }
 
 void loop() {